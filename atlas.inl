@@ -0,0 +1,10 @@
+// Generated by atlas.py from the sprites in Sprites/, do not edit
+// ATLAS_REGION(name, x, y, width, height) in pixels of the 256x128 Data/atlas.png
+ATLAS_REGION(CANNON, 1, 1, 64, 64)
+ATLAS_REGION(METAL, 67, 1, 64, 64)
+ATLAS_REGION(NERD, 35, 67, 16, 32)
+ATLAS_REGION(NERDSHIRT, 53, 67, 16, 32)
+ATLAS_REGION(SMOKE, 71, 67, 16, 16)
+ATLAS_REGION(SUMO, 199, 1, 32, 32)
+ATLAS_REGION(SUMOPANTS, 1, 67, 32, 32)
+ATLAS_REGION(WOOD, 133, 1, 64, 64)
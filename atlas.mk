@@ -0,0 +1,3 @@
+# Rebuilds the sprite atlas, run with 'make -f atlas.mk' after changing anything in Sprites/
+Data/atlas.png atlas.inl: atlas.py $(wildcard Sprites/*.png)
+	python3 atlas.py
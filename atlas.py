@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Packs the sprites in Sprites/ into Data/atlas.png and writes their regions to atlas.inl
+# Run with 'make -f atlas.mk' after changing any sprite (no dependencies besides python3)
+
+import os, struct, zlib
+
+SPRITES, ATLAS_PNG, ATLAS_INL = 'Sprites', 'Data/atlas.png', 'atlas.inl'
+ATLAS_WIDTH, PAD = 256, 1 # every sprite gets its edge pixels repeated into a 1 pixel border against filter bleeding
+
+def read_png(path):
+	data = open(path, 'rb').read()
+	assert data[:8] == b'\x89PNG\r\n\x1a\n', path + ': not a png file'
+	pos, idat = 8, b''
+	while pos < len(data):
+		size, kind = struct.unpack('>I4s', data[pos:pos+8])
+		chunk = data[pos+8:pos+8+size]
+		if kind == b'IHDR': w, h, depth, ctype, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+		if kind == b'IDAT': idat += chunk
+		pos += 12 + size
+	assert depth == 8 and ctype in (2, 6) and not interlace, path + ': only 8-bit non-interlaced RGB/RGBA is supported'
+	bpp = (3 if ctype == 2 else 4)
+	raw, stride, prev, rows = zlib.decompress(idat), w * bpp, bytearray(w * bpp), []
+	for y in range(h):
+		ftype, line = raw[y*(stride+1)], bytearray(raw[y*(stride+1)+1:(y+1)*(stride+1)])
+		for i in range(stride):
+			a, b = (line[i-bpp] if i >= bpp else 0), prev[i]
+			c = (prev[i-bpp] if i >= bpp else 0)
+			if   ftype == 1: line[i] = (line[i] + a) & 255
+			elif ftype == 2: line[i] = (line[i] + b) & 255
+			elif ftype == 3: line[i] = (line[i] + ((a + b) >> 1)) & 255
+			elif ftype == 4:
+				p = a + b - c; pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+				line[i] = (line[i] + (a if pa <= pb and pa <= pc else (b if pb <= pc else c))) & 255
+		rows.append(line if bpp == 4 else bytearray(b''.join(bytes(line[x*3:x*3+3]) + b'\xff' for x in range(w))))
+		prev = line
+	return w, h, rows
+
+def write_png(path, w, h, rows):
+	def chunk(kind, body): return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body) & 0xffffffff)
+	raw = b''.join(b'\0' + bytes(r) for r in rows)
+	open(path, 'wb').write(b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', struct.pack('>IIBBBBB', w, h, 8, 6, 0, 0, 0)) + chunk(b'IDAT', zlib.compress(raw, 9)) + chunk(b'IEND', b''))
+
+sprites = [(os.path.splitext(f)[0],) + read_png(os.path.join(SPRITES, f)) for f in sorted(os.listdir(SPRITES)) if f.endswith('.png')]
+
+# Shelf packing, tallest sprites first
+x, y, shelf, regions = 0, 0, 0, []
+for name, w, h, rows in sorted(sprites, key = lambda s: (-s[2], -s[1], s[0])):
+	if x + w + PAD*2 > ATLAS_WIDTH: x, y, shelf = 0, y + shelf, 0
+	regions.append((name, x + PAD, y + PAD, w, h, rows))
+	x, shelf = x + w + PAD*2, max(shelf, h + PAD*2)
+height = 1
+while height < y + shelf: height *= 2
+
+atlas = [bytearray(ATLAS_WIDTH * 4) for _ in range(height)]
+for name, rx, ry, w, h, rows in regions:
+	for py in range(-PAD, h + PAD):
+		src = rows[min(max(py, 0), h - 1)]
+		src = src[:4] * PAD + src + src[-4:] * PAD
+		atlas[ry + py][(rx - PAD) * 4:(rx + w + PAD) * 4] = src
+write_png(ATLAS_PNG, ATLAS_WIDTH, height, atlas)
+
+with open(ATLAS_INL, 'w', newline = '\r\n') as f:
+	f.write('// Generated by atlas.py from the sprites in %s/, do not edit\n' % SPRITES)
+	f.write('// ATLAS_REGION(name, x, y, width, height) in pixels of the %dx%d %s\n' % (ATLAS_WIDTH, height, ATLAS_PNG))
+	for name, rx, ry, w, h, rows in sorted(regions):
+		f.write('ATLAS_REGION(%s, %d, %d, %d, %d)\n' % (name.upper(), rx, ry, w, h))
@@ -27,22 +27,141 @@
 #include <ZL_Font.h>
 #include <ZL_Scene.h>
 #include <ZL_Input.h>
-#include <ZL_Particles.h>
 #include <ZL_SynthImc.h>
 #include <ZL_Thread.h>
 #include <../Opt/chipmunk/chipmunk.h>
 #include <vector>
+#include <chrono>
+#if !defined(__WEBAPP__)
+#define HAS_THREADS
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#endif
+#if defined(HAS_THREADS) && !defined(__SMARTPHONE__)
+#define HAS_HEADLESS
+#include <stdlib.h>
+#endif
+#if defined(HAS_HEADLESS) && !defined(_WIN32)
+#define HAS_VERIFIER
+#include <dirent.h>
+#include <string>
+#include <algorithm>
+#define HAS_CAPTURE
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#endif
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define HAS_SSE
+#include <xmmintrin.h>
+#endif
 #define TINYSAM_IMPLEMENTATION
 #include "tinysam.h"
 
 extern ZL_SynthImcTrack imcMusic;
 extern TImcSongData imcDataIMCCANNON, imcDataIMCHIT, imcDataIMCCLEAR, imcDataIMCFAIL, imcDataIMCMUSIC;
 static ZL_Font fntMain;
-static ZL_TextBuffer txtBuf;
-static ZL_Surface srfGround, srfWood, srfMetal, srfCannon, srfNerd, srfNerdShirt, srfSumo, srfSumoPants;
+static ZL_Surface srfGround, srfWhite, srfAtlas, srfWood, srfMetal, srfCannon, srfNerd, srfNerdShirt, srfSumo, srfSumoPants, srfSmoke;
 static ZL_Sound sndCannon, sndHit, sndClear, sndFail;
-static ZL_ParticleEffect particleSmoke;
-static tinysam* ts;
+
+// Render statistics of the game screen, counted at the draw call sites with a batch counting as one call and a texture bind counted on every switch
+static struct SRenderStats
+{
+	int drawCalls, vertices, textureBinds, texts, particles;
+	const void* texture;
+	void Reset() { drawCalls = vertices = textureBinds = texts = particles = 0; texture = NULL; }
+	void Add(int verts, const void* tex = NULL) { drawCalls++; vertices += verts; if (tex && tex != texture) { textureBinds++; texture = tex; } }
+} RenderStats, RenderStatsLast;
+static ticks_t RenderStatsLogTicks;
+
+//All sprites share one texture (Data/atlas.png packed from Sprites/ by atlas.py) so drawing a frame barely switches textures
+enum eAtlasRegion
+{
+	#define ATLAS_REGION(name, x, y, w, h) ATLAS_##name,
+	#include "atlas.inl"
+	#undef ATLAS_REGION
+	ATLAS_REGION_COUNT
+};
+static const ZL_Rectf AtlasRegions[ATLAS_REGION_COUNT] =
+{
+	#define ATLAS_REGION(name, x, y, w, h) ZL_Rectf(x, y, x+w, y+h),
+	#include "atlas.inl"
+	#undef ATLAS_REGION
+};
+
+// Smoke of knocked out sumos, stored as one array per attribute so moving and aging the particles runs four at a time
+#define SMOKE_BUDGET 4096
+static struct sSmoke
+{
+	float x[SMOKE_BUDGET], y[SMOKE_BUDGET], vx[SMOKE_BUDGET], vy[SMOKE_BUDGET], age[SMOKE_BUDGET], life[SMOKE_BUDGET];
+	int count;
+
+	void Spawn(int n, const ZL_Vector& p)
+	{
+		// Once half of the budget is used each burst gets thinner instead of new smoke stopping altogether
+		if (count > SMOKE_BUDGET/2) n = n * (SMOKE_BUDGET - count) / (SMOKE_BUDGET/2);
+		if (n > SMOKE_BUDGET - count) n = SMOKE_BUDGET - count;
+		for (; n > 0; n--, count++)
+		{
+			ZL_Vector v = RAND_ANGLEVEC * RAND_RANGE(5, 115);
+			x[count] = p.x; y[count] = p.y;
+			vx[count] = v.x; vy[count] = v.y;
+			age[count] = 0;
+			life[count] = RAND_RANGE(.15, .45);
+		}
+	}
+
+	void Update(float dt)
+	{
+		int i = 0;
+		#ifdef HAS_SSE
+		__m128 vdt = _mm_set1_ps(dt);
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(_mm_loadu_ps(vx + i), vdt)));
+			_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(vy + i), vdt)));
+			_mm_storeu_ps(age + i, _mm_add_ps(_mm_loadu_ps(age + i), vdt));
+		}
+		#endif
+		for (; i < count; i++) { x[i] += vx[i] * dt; y[i] += vy[i] * dt; age[i] += dt; }
+
+		// Remove expired particles by moving the last one into their place
+		for (int j = count; j--;)
+		{
+			if (age[j] < life[j]) continue;
+			count--;
+			x[j] = x[count]; y[j] = y[count]; vx[j] = vx[count]; vy[j] = vy[count]; age[j] = age[count]; life[j] = life[count];
+		}
+	}
+
+	void Draw(const ZL_Rectf& view)
+	{
+		if (!count) return;
+		int drawn = 0;
+		srfSmoke.BatchRenderBegin(true);
+		for (int i = 0; i != count; i++)
+		{
+			if (x[i] < view.left - 16 || x[i] > view.right + 16 || y[i] < view.low - 16 || y[i] > view.high + 16) continue;
+			float t = age[i] / life[i], scale = 1.1f - .6f * t; //fades from half opacity and 110% size to nothing and 50%
+			srfSmoke.Draw(x[i], y[i], scale, scale, ZLLUMA(.5, .5f - .5f * t));
+			drawn++;
+		}
+		srfSmoke.BatchRenderEnd();
+		if (drawn) RenderStats.Add(drawn * 4, &srfAtlas);
+		RenderStats.particles += drawn;
+	}
+} Smoke;
 #if !defined(__SMARTPHONE__) && !defined(__WEBAPP__)
 static ZL_Mutex tsmtx;
 #define TSMTXLOCK() tsmtx.Lock();
@@ -51,21 +170,18 @@ static ZL_Mutex tsmtx;
 #define TSMTXLOCK()
 #define TSMTXUNLOCK()
 #endif
-static cpSpace *space = NULL;
-static cpBody *ground = NULL;
-static int remainTicks;
 static ticks_t ticksClear, ticksFailed;
 
-static int level, level_sides, level_decks, remain_sumos, total_sumos;
-static float level_width, level_height, level_decky[10];
-
 static bool OnTitle = true;
 static ticks_t titleswitchtick;
-static float CannonRange;
-static float CannonY = 150.0f;
-static float CameraX = 0, CameraZoom = 1.0f;
-static ZL_Vector CannonVel;
+static bool RapidFire, HintEnabled, ProfilePhysics;
+static ticks_t ticksRapidFire, ticksRapidFireSound;
 static ZL_Color colSkyTop, colSkyTopTarget, colSkyBottom, colSkyBottomTarget;
+static ZL_Rectf ViewRect(-10000, -10000, 10000, 10000); //world area visible on screen in the last drawn frame
+
+// Lerp which lands exactly on the target once it gets close, so layers cached by these values stop being redrawn
+static float LerpSettle(float from, float to, float f, float epsilon) { float r = ZL_Math::Lerp(from, to, f); return (sabs(to - r) < epsilon ? to : r); }
+static ZL_Color LerpSettle(const ZL_Color& from, const ZL_Color& to, float f) { return ZL_Color(LerpSettle(from.r, to.r, f, 1/512.f), LerpSettle(from.g, to.g, f, 1/512.f), LerpSettle(from.b, to.b, f, 1/512.f), LerpSettle(from.a, to.a, f, 1/512.f)); }
 
 static const struct SLevelSettings { int sides, decks, rooms, max_floors; float width_from, width_to; } LevelSettings[] = 
 {
@@ -87,6 +203,19 @@ static const struct SLevelSettings { int sides, decks, rooms, max_floors; float
 	/* 15 */ {     1,      3,      5,       99,        1000,   1500 },
 };
 
+// Sandbox presets for scaling tests, built with the same room generator (approximate body counts)
+static const SLevelSettings SandboxSettings[] = 
+{
+	// sandbox   sides | decks | rooms | max_floors | width range
+	/*  1 */ {     3,      2,     99,       10,        3000,   3500 }, //  ~2000 bodies
+	/*  2 */ {     3,      4,     99,       12,        6000,   6500 }, // ~11000 bodies
+	/*  3 */ {     3,     10,     99,       10,        8500,   9000 }, // ~33000 bodies
+};
+#define IS_SANDBOX_LEVEL(lvl) ((lvl) >= (int)COUNT_OF(LevelSettings))
+
+static struct SSandboxStats { float stepMs, scanMs, drawMs; ticks_t logTicks; } SandboxStats;
+static double PerfMs() { return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count(); }
+
 static ZL_Vector linepos;
 static ticks_t lineticks;
 static const char* lastline;
@@ -307,522 +436,2336 @@ struct sThing
 };
 
 enum CollisionTypes { COLLISION_TOWER = 1, COLLISION_SUMO };
-
-static std::vector<sThing> things;
-
-static void AddThing(cpBody *body, sThing::eType type, ZL_Color color = ZLWHITE)
+enum CollisionGroups { GROUP_RAPIDFIRE = 1 };
+enum CollisionCategories { CATEGORY_NERD = 1<<1 };
+
+#define WORLD_GRAVITY (-98.7f*3)
+#define PHYSICS_TICK 16
+#define PHYSICS_STEP s(PHYSICS_TICK/1000.0)
+#define TRAJECTORY_SEGMENTS 60
+#define TRAJECTORY_SEGMENT_TIME .06f
+#define LEVEL_TIME(lvl) (IS_SANDBOX_LEVEL(lvl) ? 60000 : 10000)
+
+#define MAX_NERDS 400
+#define RAPIDFIRE_INTERVAL 33
+#define RAPIDFIRE_TICKS (RAPIDFIRE_INTERVAL/PHYSICS_TICK)
+#define RAPIDFIRE_SPREAD .06f
+#define RAPIDFIRE_OFFSET 20.0f
+#define CANNON_MIN_Y 50.0f
+#define CANNON_SPEED(heldTicks) ZL_Math::Clamp(100.0f + (heldTicks) * (float)PHYSICS_TICK, 100.0f, 2500.0f)
+#define CANNON_MOVE_SPEED 250.0f //units per second
+
+// Removed nerds are kept with their shape for reuse so rapid fire doesn't allocate bodies on each shot
+struct sPooledBody { cpBody *body; cpShape *shape; };
+
+// Player input of a level, applied before the physics tick it is logged with (a rapid fire volley is three consecutive shots)
+struct sInputEvent { enum eType { CHARGE, RELEASE, FIRE } type; int tick; ZL_Vector pos, vel; bool rapid; };
+
+static cpSpace* NewGameSpace(cpCollisionBeginFunc funcTowerToSumo, cpDataPointer userData)
 {
-	things.push_back({body, type, color});
+	cpSpace *newspace = cpSpaceNew();
+	cpSpaceSetGravity(newspace, cpv(0.0f, WORLD_GRAVITY));
+	cpCollisionHandler *handler = cpSpaceAddCollisionHandler(newspace, COLLISION_TOWER, COLLISION_SUMO);
+	handler->beginFunc = funcTowerToSumo;
+	handler->userData = userData;
+	return newspace;
 }
 
-static void RemoveThing(size_t i, bool effect = true)
+static cpBody* AddLevelBody(cpSpace *target, sThing::eType type, cpFloat w, cpFloat h, bool rapid = false)
 {
-	sThing t = things[i];
-	if (t.type == sThing::SUMO && effect)
-	{
-		particleSmoke.Spawn(200, t.body->p);
-		sndHit.Play();
-	}
-	cpSpaceRemoveShape(space, t.body->shapeList);
-	cpSpaceRemoveBody(space, t.body);
-	cpShapeFree(t.body->shapeList);
-	cpBodyFree(t.body);
-	things.erase(things.begin() + i);
-
+	cpFloat mass = (type == sThing::NERD ? 100 : 13);
+	cpBody *b = cpSpaceAddBody(target, cpBodyNew(mass, cpMomentForBox(mass, w, h)));
+	cpShape* shape = cpSpaceAddShape(target, cpBoxShapeNew(b, w, h, 0));
+	cpShapeSetFriction(shape, 100);
+	cpShapeSetCollisionType(shape, (type == sThing::SUMO ? COLLISION_SUMO : COLLISION_TOWER));
+	// Nerds of a rapid fire stream share a group so they don't collide with each other
+	if (type == sThing::NERD) cpShapeSetFilter(shape, cpShapeFilterNew((rapid ? GROUP_RAPIDFIRE : CP_NO_GROUP), CATEGORY_NERD, CP_ALL_CATEGORIES));
+	return b;
 }
 
-static void DrawTextBordered(const ZL_TextBuffer& buf, const ZL_Vector& p, scalar scale = 1, const ZL_Color& colfill = ZLWHITE, const ZL_Color& colborder = ZLBLACK, int border = 2, ZL_Origin::Type origin = ZL_Origin::Center)
-{
-	for (int i = 0; i < 9; i++) if (i != 4) buf.Draw(p.x+(border*((i%3)-1)), p.y+(border*((i/3)-1)), scale, scale, colborder, origin);
-	buf.Draw(p.x, p.y, scale, scale, colfill, origin);
-}
+// Rules checked after every physics tick, used by every sSession so replays give the same result
+static bool IsSumoKnockedOut(const cpBody *b) { return sabs(b->a) > .4f || cpvlengthsq(b->v) > 5000; }
+static bool IsNerdLost(const cpBody *b, float width) { return b->p.y < -500.0f || sabs(b->p.x) > width + 3000.0f; }
 
-static void BuildLevel(int goto_level)
+// Chipmunk sleeping is not enabled in the game space, rendering decides if a body is at rest by its velocity
+static bool IsBodyResting(const cpBody *b) { return cpvlengthsq(b->v) < 1.0f && sabs(b->w) < .01f; }
+
+// Text with a black border, rendered into its own surface whenever it changes so drawing it is a single quad instead of nine text draws
+// The fill is rendered white so it can be tinted with any color when drawing. The render target only grows and is reused for
+// shorter texts, which are rendered into its center and drawn through a clipped view.
+struct sOutlinedText
 {
-	while (things.size()) RemoveThing(things.size()-1, false);
-	while (ground->shapeList)
+	ZL_Surface srf, view;
+	scalar renderScale;
+	sOutlinedText() : renderScale(1) { }
+	sOutlinedText(const ZL_TextBuffer& buf, scalar scale, int border = 2) { Render(buf, scale, border); }
+	void Render(const ZL_TextBuffer& buf, scalar scale, int border = 2)
 	{
-		cpShape* groundshape = ground->shapeList;
-		cpSpaceRemoveShape(space, groundshape);
-		cpShapeFree(groundshape);
+		ZL_Vector size = buf.GetDimensions() * scale + ZLV(border*2+2, border*2+2);
+		int w = (int)size.x, h = (int)size.y;
+		if (!srf || srf.GetWidth() < w || srf.GetHeight() < h)
+			srf = ZL_Surface(ZL_Math::Max(w, (srf ? srf.GetWidth() : 0)), ZL_Math::Max(h, (srf ? srf.GetHeight() : 0)), true);
+		ZL_Vector center(srf.GetWidth() / 2, srf.GetHeight() / 2);
+		srf.RenderToBegin(true);
+		DrawBordered(buf, center, scale, ZLWHITE, border);
+		srf.RenderToEnd();
+		view = srf.Clone().SetClipping(ZL_Rectf(center.x - w/2, center.y - h/2, center.x - w/2 + w, center.y - h/2 + h));
+		renderScale = scale;
 	}
+	void Draw(const ZL_Vector& p, scalar scale = 1, const ZL_Color& colfill = ZLWHITE, ZL_Origin::Type origin = ZL_Origin::Center)
+	{
+		view.SetOrigin(origin).Draw(p.x, p.y, scale/renderScale, scale/renderScale, colfill);
+		RenderStats.Add(4, &srf);
+		RenderStats.texts++;
+	}
+	static void DrawBordered(const ZL_TextBuffer& buf, const ZL_Vector& p, scalar scale, const ZL_Color& colfill, int border = 2, ZL_Origin::Type origin = ZL_Origin::Center)
+	{
+		for (int i = 0; i < 9; i++) if (i != 4) buf.Draw(p.x+(border*((i%3)-1)), p.y+(border*((i/3)-1)), scale, scale, ZLBLACK, origin);
+		buf.Draw(p.x, p.y, scale, scale, colfill, origin);
+	}
+};
 
+// HUD text which only gets formatted and laid out again when one of the values shown in it changes
+// Debug lines which change nearly every frame are drawn with the border directly instead of being pre-rendered
+struct sTextSlot
+{
+	ZL_TextBuffer buf;
+	sOutlinedText text;
+	scalar scale;
+	int keys[7], chars;
+	bool valid, prerender;
+	sTextSlot(scalar scale = 1, bool prerender = true) : scale(scale), chars(0), valid(false), prerender(prerender) { }
+	bool Changed(int k0, int k1 = 0, int k2 = 0, int k3 = 0, int k4 = 0, int k5 = 0, int k6 = 0)
+	{
+		int newkeys[7] = { k0, k1, k2, k3, k4, k5, k6 };
+		if (valid && !memcmp(keys, newkeys, sizeof(keys))) return false;
+		memcpy(keys, newkeys, sizeof(keys));
+		return true;
+	}
+	void Set(const char* fmt, ...)
 	{
-		cpShape* groundshape = cpSpaceAddShape(space, cpBoxShapeNew2(ground, cpBBNew(-10000, -20, 10000, 0), 0));
-		cpShapeSetFriction(groundshape, 100);
+		char str[256];
+		va_list ap; va_start(ap, fmt); vsnprintf(str, sizeof(str), fmt, ap); va_end(ap);
+		if (!valid) buf = ZL_TextBuffer(fntMain, 0.5f, str);
+		else buf.SetText(0.5f, str);
+		if (prerender) text.Render(buf, scale);
+		chars = (int)strlen(str);
+		valid = true;
 	}
+	void Draw(const ZL_Vector& p, scalar drawscale = 1, const ZL_Color& colfill = ZLWHITE, ZL_Origin::Type origin = ZL_Origin::Center)
+	{
+		if (prerender) { text.Draw(p, drawscale, colfill, origin); return; }
+		sOutlinedText::DrawBordered(buf, p, drawscale, colfill, 2, origin);
+		for (int i = 0; i != 9; i++) RenderStats.Add(chars * 4);
+		RenderStats.texts++;
+	}
+};
+#define HUNDREDTHS(v) ((int)((v)*100.0f+.5f))
 
-	level = ZL_Math::Clamp(goto_level, 0, (int)COUNT_OF(LevelSettings) - 1);
-	level_sides = LevelSettings[level].sides;
-	level_decks = LevelSettings[level].decks;
-	int room_per_deck = LevelSettings[level].rooms;
-	int max_floors = LevelSettings[level].max_floors;
-	float max_x_from = LevelSettings[level].width_from;
-	float max_x_to = LevelSettings[level].width_to;
+// Plain copy of the state of a level which can be instantiated into a separate chipmunk space
+struct sLevelSnapshot
+{
+	struct sBody { sThing::eType type; cpVect p, v; cpFloat a, w, width, height; };
+	std::vector<sBody> bodies;
+	std::vector<cpBB> grounds;
+	int sides, decks, sumos;
+	float width, height, decky[10];
+};
 
-	total_sumos = 0;
-	int numy = 3;
+// Generate the towers of a level, only depending on the level settings and the seed
+static void GenerateLevel(int lvl, unsigned int seed, sLevelSnapshot& snap)
+{
+	ZL_SeededRand rnd(seed);
+	snap.bodies.clear();
+	snap.grounds.clear();
+	snap.grounds.push_back(cpBBNew(-10000, -20, 10000, 0));
+
+	const SLevelSettings& settings = (IS_SANDBOX_LEVEL(lvl) ? SandboxSettings[lvl - COUNT_OF(LevelSettings)] : LevelSettings[lvl]);
+	snap.sides = settings.sides;
+	snap.decks = settings.decks;
+	int room_per_deck = settings.rooms;
+	int max_floors = settings.max_floors;
+	float max_x_from = settings.width_from;
+	float max_x_to = settings.width_to;
+
+	snap.sumos = 0;
 	float decky = 0;
-	level_width = level_height = 0;
-	for (int deck = 0; deck != level_decks; deck++, decky = level_height)
+	snap.width = snap.height = 0;
+	for (int deck = 0; deck != snap.decks; deck++, decky = snap.height)
 	{
-		level_decky[deck] = decky;
+		snap.decky[deck] = decky;
 		for (float towerflip = -1.0f; towerflip < 1.1f; towerflip += 2.0f)
 		{
-			if ((towerflip < 0 && !(level_sides & 2)) || (towerflip > 0 && !(level_sides & 1))) continue;
+			if ((towerflip < 0 && !(snap.sides & 2)) || (towerflip > 0 && !(snap.sides & 1))) continue;
 
 			if (deck)
 			{
 				ZL_Vector groundpos((200 + 5000) * towerflip, decky - 10);
-				cpShape* groundshape = cpSpaceAddShape(space, cpBoxShapeNew2(ground, cpBBNew(groundpos.x - 5000, groundpos.y - 10, groundpos.x + 5000, groundpos.y + 10), 0));
-				cpShapeSetFriction(groundshape, 100);
+				snap.grounds.push_back(cpBBNew(groundpos.x - 5000, groundpos.y - 10, groundpos.x + 5000, groundpos.y + 10));
 			}
 
 			float min_x = 200.0f;
-			float max_x = RAND_RANGE(max_x_from, max_x_to);
-			if (max_x > level_width) level_width = max_x;
+			float max_x = rnd.Range(max_x_from, max_x_to);
+			if (max_x > snap.width) snap.width = max_x;
 
 			float y = decky;
 			for (float ymax = y + (max_floors - .9f) * 100.0f; y <= ymax; y += 100.0f)
 			{
-				max_x -= RAND_RANGE(0,50);
+				max_x -= rnd.Range(0.0f, 50.0f);
 				bool lastroom = false;
-				for (float roomn = 0.1f, x = max_x, roomw = RAND_RANGE(104, 200), nextroomw; ; x -= roomw, roomw = nextroomw, roomn++)
+				for (float roomn = 0.1f, x = max_x, roomw = rnd.Range(104.0f, 200.0f), nextroomw; ; x -= roomw, roomw = nextroomw, roomn++)
 				{
 					bool firstroom = !(int)roomn;
 					roomw = ZL_Math::Min(roomw, x - min_x);
 					if (firstroom && roomw < 102) goto towerDone;
 
-					{
-						cpBody *b = cpSpaceAddBody(space, cpBodyNew(13, cpMomentForBox(13, 20, 80)));
-						cpShape* shape = cpSpaceAddShape(space, cpBoxShapeNew(b, 20, 80, 0));
-						cpBodySetPosition(b, cpv(x * towerflip, y + 40));
-						cpShapeSetFriction(shape, 100);
-						cpShapeSetCollisionType(shape, COLLISION_TOWER);
-						AddThing(b, sThing::WALL);
-					}
+					snap.bodies.push_back({sThing::WALL, cpv(x * towerflip, y + 40), cpvzero, 0, 0, 20, 80});
 					if (lastroom) { min_x = x; break; }
 
-					nextroomw = RAND_RANGE(104, 200);
+					nextroomw = rnd.Range(104.0f, 200.0f);
 					lastroom = (x - roomw - nextroomw < min_x || (y == decky && (int)roomn + 1 == room_per_deck));
 					float l = x - roomw - (lastroom ? 10 : 0), r = x + (firstroom ? 10 : 0);
-					{
-						cpBody *b = cpSpaceAddBody(space, cpBodyNew(13, cpMomentForBox(13, r-l, 20)));
-						cpShape* shape = cpSpaceAddShape(space, cpBoxShapeNew(b, r-l, 20, 0));
-						cpBodySetPosition(b, cpv((l + (r-l) / 2) * towerflip, y + 90));
-						cpShapeSetFriction(shape, 100);
-						cpShapeSetCollisionType(shape, COLLISION_TOWER);
-						AddThing(b, sThing::FLOOR);
-					}
-					{
-						cpBody *b = cpSpaceAddBody(space, cpBodyNew(13, cpMomentForBox(13, 60, 60)));
-						cpShape* shape = cpSpaceAddShape(space, cpBoxShapeNew(b, 60, 60, 0));
-						cpBodySetPosition(b, cpv((l + (r-l) / 2) * towerflip, y + 32));
-						cpShapeSetFriction(shape, 100);
-						cpShapeSetCollisionType(shape, COLLISION_SUMO);
-						AddThing(b, sThing::SUMO, RAND_COLOR);
-						total_sumos++;
-					}
+					snap.bodies.push_back({sThing::FLOOR, cpv((l + (r-l) / 2) * towerflip, y + 90), cpvzero, 0, 0, r-l, 20});
+					snap.bodies.push_back({sThing::SUMO, cpv((l + (r-l) / 2) * towerflip, y + 32), cpvzero, 0, 0, 60, 60});
+					snap.sumos++;
 				}
 			}
 			towerDone:
 			y+= 100.0f;
-			if (y > level_height) level_height = y;
+			if (y > snap.height) snap.height = y;
 		}
 	}
-	remainTicks = 10000;
-	ticksClear = ticksFailed = 0;
-	remain_sumos = total_sumos;
-	level_width = (level_width * 1.1f) * (level_sides == 3 ? 2 : 1);
+	snap.width = (snap.width * 1.1f) * (snap.sides == 3 ? 2 : 1);
+}
 
-	static const ZL_Color skyColsTop[] = { ZLRGBFF( 23, 79,193) , ZLRGBFF( 16, 50,138) , ZLRGBFF(240,181, 52) , ZLRGBFF( 14, 38, 80) , ZLRGBFF( 54, 66,140) , ZLRGBFF( 22, 44, 68) , ZLRGBFF(141,104,137) , ZLRGBFF( 53, 57, 67) , ZLRGBFF(  9, 14, 39) , ZLRGBFF( 95,118,130) };
-	static const ZL_Color skyColsBot[] = { ZLRGBFF( 97,169,255) , ZLRGBFF(228,217,177) , ZLRGBFF(143, 61, 69) , ZLRGBFF(209,214,194) , ZLRGBFF(247,131, 62) , ZLRGBFF(232,192,109) , ZLRGBFF(252,170, 80) , ZLRGBFF(223,202,162) , ZLRGBFF(209,210,211) , ZLRGBFF(114, 59, 70) };
+#define JOB_GRAIN 256 //also the chunk size of serial scans so their float sums match the parallel ones
+#ifdef HAS_THREADS
+#define JOB_MIN_ITEMS 1024
 
-	if (level > 0)
+// Small work stealing job system for splitting up per-frame work. Every thread has its own queue, the owner takes jobs
+// from the back and threads without work steal from the front of other queues. The calling thread helps until done.
+static struct sJobSystem
+{
+	struct sJob { const std::function<void(size_t, size_t)>* func; size_t from, to; std::atomic<int>* pending; };
+	struct sQueue { std::mutex mtx; std::deque<sJob> jobs; };
+	std::vector<std::thread> threads;
+	std::vector<sQueue*> queues; //queue 0 belongs to the thread calling ParallelFor
+	std::atomic<int> queued;
+	std::atomic<bool> quit;
+	std::mutex sleepMtx;
+	std::condition_variable wake;
+
+	sJobSystem() : queued(0), quit(false) { }
+	~sJobSystem() { Stop(); }
+
+	void Start(int numWorkers)
 	{
-		colSkyTopTarget = RAND_ARRAYELEMENT(skyColsTop);
-		colSkyBottomTarget = RAND_ARRAYELEMENT(skyColsBot);
+		queues.push_back(new sQueue);
+		for (int i = 1; i <= numWorkers; i++) queues.push_back(new sQueue);
+		for (int i = 1; i <= numWorkers; i++) threads.emplace_back(&sJobSystem::Worker, this, (size_t)i);
 	}
-	else
+
+	void Stop()
 	{
-		colSkyTopTarget = colSkyTop = skyColsTop[0];
-		colSkyBottomTarget = colSkyBottom = skyColsBot[0];
-		CannonY = 150.0f;
+		{ std::lock_guard<std::mutex> lock(sleepMtx); quit = true; }
+		wake.notify_all();
+		for (std::thread& t : threads) t.join();
+		threads.clear();
+		for (sQueue* q : queues) delete q;
+		queues.clear();
 	}
-}
-
-static void PostStepRemoveBody(cpSpace *space, cpBody* body, void* data)
-{
-	for (size_t i = things.size(); i--;) { if (things[i].body == body) { RemoveThing(i); return; } }
-}
-
-static cpBool CollisionTowerToSumo(cpArbiter *arb, cpSpace *space, cpDataPointer userData)
-{
-	CP_ARBITER_GET_BODIES(arb, bTower, bSumo);
-	ZL_ASSERT(bTower->shapeList->type == COLLISION_TOWER && bSumo->shapeList->type == COLLISION_SUMO);
-	if (bSumo->p.y - 30.0f > bTower->p.y) return cpTrue;
-	cpSpaceAddPostStepCallback(space, (cpPostStepFunc)PostStepRemoveBody, bSumo, NULL);
-	return cpTrue;
-}
-
-static void Init()
-{
-	fntMain = ZL_Font("Data/matchbox.ttf.zip", 52);
-	txtBuf = ZL_TextBuffer(fntMain);
-	srfGround = ZL_Surface("Data/ground.png").SetTextureRepeatMode(true);
-	srfWood = ZL_Surface("Data/wood.png");
-	srfMetal = ZL_Surface("Data/metal.png");
-	srfCannon = ZL_Surface("Data/cannon.png").SetOrigin(ZL_Origin::Custom(.5f, .5f)).SetScale(2, 1);
-	srfNerd = ZL_Surface("Data/nerd.png").SetOrigin(ZL_Origin::Center).SetScale(1.5f);
-	srfNerdShirt = ZL_Surface("Data/nerdshirt.png").SetOrigin(ZL_Origin::Center).SetScale(1.5f);
-	srfSumo = ZL_Surface("Data/sumo.png").SetOrigin(ZL_Origin::Center).SetScale(2.0f);
-	srfSumoPants = ZL_Surface("Data/sumopants.png").SetOrigin(ZL_Origin::Center).SetScale(2.0f);
-
-	particleSmoke = ZL_ParticleEffect(300, 150);
-	particleSmoke.AddParticleImage(ZL_Surface("Data/smoke.png").SetColor(ZLLUM(.5)), 1000);
-	particleSmoke.AddBehavior(new ZL_ParticleBehavior_LinearMove(60, 55));
-	particleSmoke.AddBehavior(new ZL_ParticleBehavior_LinearImageProperties(.5f, 0, s(1.1), s(.5)));
-
-	imcMusic.Play();
-	sndCannon = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCCANNON);
-	sndHit = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCHIT);
-	sndClear = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCCLEAR);
-	sndFail = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCFAIL);
-
-	space = cpSpaceNew();
-	cpSpaceSetGravity(space, cpv(0.0f, -98.7f*3));
-	cpSpaceAddCollisionHandler(space, COLLISION_TOWER, COLLISION_SUMO)->beginFunc = CollisionTowerToSumo;
-
-	ground = cpSpaceAddBody(space, cpBodyNewStatic());
-}
-
-static void Update()
-{
-	if (OnTitle) return;
 
-	static ticks_t TICKSUM = 0;
-	for (TICKSUM += ZLELAPSEDTICKS
-		#ifdef ZILLALOG //DEBUG DRAW
-		*(ZL_Display::KeyDown[ZLK_LCTRL] ? 10 : 1)
-		#endif
-		; TICKSUM > 16; TICKSUM -= 16)
+	bool Take(size_t idx, bool steal, sJob& job)
 	{
-		cpSpaceStep(space, s(16.0/1000.0));
+		sQueue& q = *queues[idx];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		if (q.jobs.empty()) return false;
+		if (steal) { job = q.jobs.front(); q.jobs.pop_front(); }
+		else { job = q.jobs.back(); q.jobs.pop_back(); }
+		queued--;
+		return true;
 	}
 
-	float remainvel = 0;
-	remain_sumos = 0;
-	for (size_t i = things.size(); i--;)
+	bool RunOne(size_t self)
 	{
-		sThing t = things[i];
+		sJob job;
+		bool found = Take(self, false, job);
+		for (size_t i = 1; !found && i != queues.size(); i++) found = Take((self + i) % queues.size(), true, job);
+		if (!found) return false;
+		(*job.func)(job.from, job.to);
+		(*job.pending)--;
+		return true;
+	}
 
-		if (t.type == sThing::SUMO)
+	void Worker(size_t self)
+	{
+		while (!quit)
 		{
-			if (sabs(t.body->a) > .4f || cpvlengthsq(t.body->v) > 5000)
-				RemoveThing(i);
-			else
-				remain_sumos++;
+			if (RunOne(self)) continue;
+			std::unique_lock<std::mutex> lock(sleepMtx);
+			wake.wait(lock, [this]() { return quit || queued > 0; });
 		}
-		if ((t.type == sThing::WALL || t.type == sThing::FLOOR || t.type == sThing::NERD) && sabs(t.body->p.x) < level_width + 500.0f && t.body->p.y > 0.0f)
-			remainvel += cpvlengthsq(t.body->v);
 	}
 
-	if (!ticksClear && !ticksFailed)
+	// Run func over the range [0, count) in chunks of JOB_GRAIN, returns when all chunks are done
+	void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& func)
 	{
-		remainTicks = ZL_Math::Max(0, remainTicks - (int)ZLELAPSEDTICKS);
-		if (!remain_sumos)
-		{
-			ticksClear = ZLTICKS;
-			sndClear.Play();
-		}
-		else if (!remainTicks && remainvel < 500.0f && !CannonRange)
+		if (threads.empty() || count <= JOB_GRAIN) { func(0, count); return; }
+		std::atomic<int> pending(0);
+		for (size_t from = 0, n = 0; from < count; from += JOB_GRAIN, n++)
 		{
-			ticksFailed = ZLTICKS;
-			sndFail.Play();
+			sQueue& q = *queues[n % queues.size()];
+			std::lock_guard<std::mutex> lock(q.mtx);
+			q.jobs.push_back({&func, from, ZL_Math::Min(from + JOB_GRAIN, count), &pending});
+			pending++;
+			queued++;
 		}
+		{ std::lock_guard<std::mutex> lock(sleepMtx); }
+		wake.notify_all();
+		while (pending) if (!RunOne(0)) std::this_thread::yield();
 	}
+} Jobs;
+#endif
 
-	bool bPlaying = (!ticksClear && !ticksFailed && remainTicks);
-	if (ZL_Input::Down() && bPlaying) CannonRange = 100.0f;
-	else if (CannonRange && ZL_Input::Held() && remainTicks) CannonRange = ZL_Math::Clamp(CannonRange + ZLELAPSEDF(1000), 100.0f, 2500.0f);
-	else if (CannonRange && ((ZL_Input::Up() && bPlaying) || !remainTicks))
-	{
-		cpBody *b = cpSpaceAddBody(space, cpBodyNew(100, cpMomentForBox(100, 18, 36)));
-		cpShape* shape = cpSpaceAddShape(space, cpBoxShapeNew(b, 18, 36, 0));
-		cpShapeSetFriction(shape, 100);
-		cpShapeSetCollisionType(shape, COLLISION_TOWER);
-		cpBodySetPosition(b, cpv(0.0f, CannonY));
-		cpBodySetVelocity(b, ZLV2CPV(CannonVel));
-		cpBodySetAngle(b, CannonVel.GetAngle()-PIHALF);
-		AddThing(b, sThing::NERD, RAND_COLOR);
-		sndCannon.Play();
+#define PROFILER_SAMPLES 4096
+
+// Ring buffer of measurements around every physics step of the played session, can be dumped as CSV
+static struct sPhysicsProfiler
+{
+	struct sSample { int tick, update, steps, bodies, contacts, arbiters, islands, beginCalls; float stepMs; };
+	sSample samples[PROFILER_SAMPLES];
+	int count, next, update;
 
-		TSMTXLOCK();
-		tinysam_reset(ts);
-		lastline = RAND_ARRAYELEMENT(lines);
-		tinysam_speak_english(ts, lastline);
-		lineticks = ZLTICKS;
-		TSMTXUNLOCK();
+	void Reset() { count = next = update = 0; }
 
-		CannonRange = 0;
-	}
-	else CannonRange = 0;
+	// Find the root of a body in the island forest built from the arbiters (stored in the body user data while counting)
+	static cpBody* Root(cpBody* b) { while (b->userData != b) b = (cpBody*)(b->userData = ((cpBody*)b->userData)->userData); return b; }
 
-	if (!bPlaying && ZL_Input::Down())
+	void Record(cpSpace *space, int tick, float stepMs, int beginCalls)
 	{
-		if (ticksClear && ZLSINCE(ticksClear) > 250)
+		sSample& s = samples[next];
+		next = (next + 1) % PROFILER_SAMPLES;
+		if (count < PROFILER_SAMPLES) count++;
+		s.tick = tick;
+		s.update = update;
+		s.steps = 0;
+		s.stepMs = stepMs;
+		s.beginCalls = beginCalls;
+		s.bodies = space->dynamicBodies->num;
+		s.arbiters = space->arbiters->num;
+
+		// Contact pairs and islands of touching dynamic bodies, static bodies don't connect islands like in chipmunk
+		s.contacts = 0;
+		for (int i = 0; i != s.bodies; i++) { cpBody* b = (cpBody*)space->dynamicBodies->arr[i]; b->userData = b; }
+		for (int i = 0; i != s.arbiters; i++)
 		{
-			if (level == COUNT_OF(LevelSettings)-1)
-			{
-				OnTitle = true;
-				imcMusic.SetSongVolume(60);
-				titleswitchtick = ZLTICKS;
-			}
-			else
-				BuildLevel(level + 1);
+			cpArbiter* arb = (cpArbiter*)space->arbiters->arr[i];
+			s.contacts += cpArbiterGetCount(arb);
+			CP_ARBITER_GET_BODIES(arb, a, b);
+			if (cpBodyGetType(a) != CP_BODY_TYPE_DYNAMIC || cpBodyGetType(b) != CP_BODY_TYPE_DYNAMIC) continue;
+			cpBody *ra = Root(a), *rb = Root(b);
+			if (ra != rb) ra->userData = rb;
 		}
-		if (ticksFailed && ZLSINCE(ticksFailed) > 250) BuildLevel(level);
+		s.islands = 0;
+		for (int i = 0; i != s.bodies; i++) { cpBody* b = (cpBody*)space->dynamicBodies->arr[i]; if (Root(b) == b) s.islands++; }
+		for (int i = 0; i != s.bodies; i++) ((cpBody*)space->dynamicBodies->arr[i])->userData = NULL;
 	}
 
-	#ifdef ZILLALOG //DEBUG
-	if (ZL_Input::Down(ZLK_F9)) BuildLevel(level - 1);
-	if (ZL_Input::Down(ZLK_F10)) BuildLevel(level);
-	if (ZL_Input::Down(ZLK_F11)) BuildLevel(level + 1);
-	#endif
-
-	if (ZL_Input::Up(ZLK_ESCAPE, true))
+	// Store the number of steps done in the update on its samples
+	void EndUpdate(int steps)
 	{
-		OnTitle = true;
-		imcMusic.SetSongVolume(60);
+		for (int i = 1; i <= steps && i <= count; i++) samples[(next + PROFILER_SAMPLES - i) % PROFILER_SAMPLES].steps = steps;
+		update++;
 	}
 
-}
+	const sSample* Last() const { return (count ? &samples[(next + PROFILER_SAMPLES - 1) % PROFILER_SAMPLES] : NULL); }
 
-static void Draw()
-{
-	if (OnTitle)
+	bool Dump(const char* path) const
 	{
-		static ZL_Color introcolor = RAND_COLOR*.2f, introcolortgt = introcolor;
-		if ((ZLTICKS%1000) >= 500 && ((ZLTICKS-ZLELAPSEDTICKS)%1000) < 500) introcolortgt = RAND_COLOR*.2f;
-		introcolor = ZL_Color::Lerp(introcolor, introcolortgt, 0.01f);
-		ZL_Display::FillGradient(-10000, -5, 10000, ZL_Display::ScreenToWorld(0,ZLHEIGHT).y, introcolor, introcolor, introcolor, introcolor);
+		FILE* f = fopen(path, "w");
+		if (!f) return false;
+		fprintf(f, "tick,update,steps_in_update,step_ms,active_bodies,contacts,arbiters,islands,begin_calls\n");
+		for (int i = 0; i != count; i++)
+		{
+			const sSample& s = samples[(next + PROFILER_SAMPLES - count + i) % PROFILER_SAMPLES];
+			fprintf(f, "%d,%d,%d,%.4f,%d,%d,%d,%d,%d\n", s.tick, s.update, s.steps, s.stepMs, s.bodies, s.contacts, s.arbiters, s.islands, s.beginCalls);
+		}
+		fclose(f);
+		return true;
+	}
+} PhysicsProfiler;
 
-		ZL_SeededRand rnd((ZLTICKS/100)*999);
-		float scale1 = rnd.Range(2.9f, 3.1f), scale2 = rnd.Range(2.9f, 3.1f);
-		txtBuf.SetText(0.5f, ZL_String::format("ANGRY\nNERDS"));
-		ZL_Display::PushMatrix();
-		ZL_Display::Translate(ZLHALFW, ZLHALFH+100);
-		ZL_Display::Rotate(rnd.Variation(.1f));
-		txtBuf.Draw(rnd.AngleVec()*40, scale1, scale1, ZLLUMA(0, .5), ZL_Origin::Center);
-		ZL_Display::PopMatrix();
-		ZL_Display::PushMatrix();
-		ZL_Display::Translate(ZLHALFW, ZLHALFH+100);
-		ZL_Display::Rotate(rnd.Variation(.1f));
-		DrawTextBordered(txtBuf, ZL_Vector::Zero, scale2, ZL_Color(introcolor.g*5, introcolor.b*5, introcolor.r*5), ZLBLACK, 2);
-		ZL_Display::PopMatrix();
+// All state of one running game, each session simulates its own chipmunk space so a process can host many of them
+struct sSession
+{
+	cpSpace *space;
+	cpBody *ground;
+	std::vector<sThing> things;
+	std::vector<sPooledBody> nerdPool;
+	int level, level_sides, level_decks, remain_sumos, total_sumos, live_nerds, knocked;
+	float level_width, level_height, level_decky[10];
+
+	// Input of the current level, together with the level seed this is a replayable claim of the result
+	std::vector<sInputEvent> inputLog;
+	unsigned int level_seed;
+	int level_tick, remainTicks;
+	enum eResult { PLAYING, CLEARED, FAILED } result;
+	bool charging;
+	int chargeTick, volleyTick;
+
+	float CannonRange, CannonY;
+	ZL_Vector CannonVel;
+	float CameraX, CameraZoom;
+	tinysam* ts;
+	bool effects; //collect knockouts for effects and pick random colors (only for the session shown on screen)
+	std::vector<ZL_Vector> knockouts; //positions of knocked out sumos not yet shown
+	ZL_SeededRand colorRnd;
+	sPhysicsProfiler* profiler; //measure every physics step when set
+	int beginCalls; //tower to sumo collision begin callbacks during the current step
+	bool parallel; //split the per-tick rules and the result scan over the job system (only for the session on the main thread)
+
+	enum eRule { KEEP, REMOVE, KNOCKOUT };
+	std::vector<eRule> rules;
+	struct sScan { int sumos; float remainvel; };
+	std::vector<sScan> scans;
+
+	sSession(bool effects = false) : space(NULL), ground(NULL), level(0), level_sides(0), level_decks(0), remain_sumos(0), total_sumos(0), live_nerds(0), knocked(0),
+		level_width(0), level_height(0), level_seed(0), level_tick(0), remainTicks(0), result(PLAYING), charging(false), chargeTick(0), volleyTick(0), CannonRange(0), CannonY(150.0f), CameraX(0), CameraZoom(1.0f), ts(NULL), effects(effects), profiler(NULL), beginCalls(0), parallel(false) { }
+
+	~sSession()
+	{
+		FreeSpace();
+		for (const sPooledBody& pb : nerdPool) { cpShapeFree(pb.shape); cpBodyFree(pb.body); }
+	}
 
-		srfSumo.Draw(150, ZLFROMH(300), 4, 4);
-		srfSumo.Draw(ZLFROMW(150), ZLFROMH(300), -4, 4);
+	// Colors come from a generator seeded by the level so sessions on other threads don't use the global one
+	ZL_Color RandomColor()
+	{
+		if (!effects) return ZLWHITE;
+		return ZL_Color(colorRnd.Range(0.0f, 1.0f), colorRnd.Range(0.0f, 1.0f), colorRnd.Range(0.0f, 1.0f));
+	}
 
-		static std::vector<ZL_Vector> nerds;
-		if (nerds.size() < 10 && (ZLTICKS%1000) >= 500 && ((ZLTICKS-ZLELAPSEDTICKS)%1000) < 500)
-			nerds.push_back(ZL_Vector(((nerds.size() & 1) ? ZLFROMW(150) : 150), ZLFROMH(300)) + RAND_ANGLEVEC * 800);
+	void AddThing(cpBody *body, sThing::eType type, ZL_Color color = ZLWHITE)
+	{
+		things.push_back({body, type, color});
+	}
 
-		for (size_t i = nerds.size(); i--;)
+	void RemoveThing(size_t i, bool knockout = false)
+	{
+		sThing t = things[i];
+		if (knockout)
 		{
-			ZL_Vector tgt(((i & 1) ? ZLFROMW(150) : 150), ZLFROMH(300));
-			nerds[i] = ZL_Vector::Lerp(nerds[i], tgt, .1f);
-			ZL_Vector dlt = tgt - nerds[i];
-			srfNerd.Draw(nerds[i], dlt.GetAngle()-PIHALF, 2, 2);
-			if (dlt < 80.0f) nerds[i] = tgt + RAND_ANGLEVEC * 800;
+			knocked++;
+			if (effects) knockouts.push_back(t.body->p);
 		}
+		cpShape* shape = t.body->shapeList;
+		cpSpaceRemoveShape(space, shape);
+		cpSpaceRemoveBody(space, t.body);
+		if (t.type == sThing::NERD)
+		{
+			nerdPool.push_back({t.body, shape});
+			live_nerds--;
+		}
+		else
+		{
+			cpShapeFree(shape);
+			cpBodyFree(t.body);
+		}
+		things.erase(things.begin() + i);
+	}
 
-		static ZL_TextBuffer txtClickToPlay(fntMain, "CLICK TO START");
-		static ZL_TextBuffer txtInfo(fntMain, 0.5f, "HOLD LEFT MOUSE BUTTON TO CHARGE THE NERD CANNON\nUSE W AND S KEYS OR RIGHT MOUSE BUTTON TO RAISE OR LOWER THE NERD CANNON");
-		static ZL_TextBuffer txtFooter(fntMain, "MADE IN 2022 BY BERNHARD SCHELLING FOR LUDUM DARE 51");
-		static ZL_TextBuffer txtFullScreen(fntMain, 0.5f, "CLICK HERE\nFULL SCREEN");
-
-		DrawTextBordered(txtClickToPlay, ZLV(ZLHALFW, 200), 1.0f, ZL_Color::Yellow, ZLBLACK, 4);
-		DrawTextBordered(txtInfo, ZLV(ZLHALFW, 120*.8f), .5f, ZLWHITE, ZLBLACK, 4);
-		DrawTextBordered(txtFooter, ZLV(ZLHALFW, 25*.5f), .4f, ZLWHITE, ZLBLACK, 3);
-
-		ZL_Rectf recFullScreen(ZLFROMW(300), ZLFROMH(140), ZLWIDTH-10, ZLHEIGHT-10);
-		bool hoverFullScreen = !!ZL_Input::Hover(recFullScreen);
-		ZL_Display::DrawRect(recFullScreen, ZLBLACK, ZLLUMA((hoverFullScreen ? .8 : .5), .5));
-		DrawTextBordered(txtFullScreen, recFullScreen.Center(), .6f, ZLWHITE, ZLBLACK, 3);
-		if (ZL_Input::Clicked(recFullScreen))
+	void FireNerd(const ZL_Vector& pos, const ZL_Vector& vel, bool rapid = false)
+	{
+		if (live_nerds >= MAX_NERDS)
 		{
-			ZL_Display::ToggleFullscreen();
+			for (size_t i = 0; i != things.size(); i++) { if (things[i].type == sThing::NERD) { RemoveThing(i); break; } }
 		}
 
-		if (ZL_Input::ClickedOutside(recFullScreen) && ZLSINCE(titleswitchtick) > 500)
+		cpBody *b;
+		if (nerdPool.size())
 		{
-			OnTitle = false;
-			imcMusic.SetSongVolume(40);
-			BuildLevel(0);
+			b = cpSpaceAddBody(space, nerdPool.back().body);
+			cpShapeSetFilter(cpSpaceAddShape(space, nerdPool.back().shape), cpShapeFilterNew((rapid ? GROUP_RAPIDFIRE : CP_NO_GROUP), CATEGORY_NERD, CP_ALL_CATEGORIES));
+			nerdPool.pop_back();
+			// A reused body still has the bias velocity of its last step which a new body wouldn't have
+			b->v_bias = cpvzero;
+			b->w_bias = 0;
 		}
-		if (ZL_Input::Up(ZLK_ESCAPE, true) && ZLSINCE(titleswitchtick) > 500)
-			ZL_Application::Quit();
-		return;
+		else b = AddLevelBody(space, sThing::NERD, 18, 36, rapid);
+		cpBodySetPosition(b, ZLV2CPV(pos));
+		cpBodySetVelocity(b, ZLV2CPV(vel));
+		cpBodySetAngle(b, vel.GetAngle()-PIHALF);
+		cpBodySetAngularVelocity(b, 0);
+		AddThing(b, sThing::NERD, RandomColor());
+		live_nerds++;
+		inputLog.push_back({sInputEvent::FIRE, level_tick, pos, vel, rapid});
 	}
 
-	// Calculate camera transform
-	float targetCameraX = 0;
-	if (level_sides & 1) targetCameraX -= ZLHALFW-100;
-	if (level_sides & 2) targetCameraX += ZLHALFW-100;
-	float targetCameraZoom = ZL_Math::Min(ZLWIDTH / (level_width + 100), ZLHEIGHT / level_height);
-	CameraX = ZL_Math::Lerp(CameraX, targetCameraX, .1f);
-	CameraZoom = ZL_Math::Lerp(CameraZoom, targetCameraZoom, .1f);
+	// Rules of the player input, the game only applies input they allow and the verifier rejects claims with any other input
+	float ChargedSpeed() const { return CANNON_SPEED(level_tick - chargeTick); }
+	bool CanCharge() const { return (!charging && remainTicks > 0); }
+	bool CanRelease() const { return charging; }
 
-	// Transform camera
-	ZL_Display::PushMatrix();
-	ZL_Display::Translate(ZLHALFW + CameraX, 0);
-	ZL_Display::Scale(CameraZoom);
-	ZL_Display::Translate(0, 50);
+	void Charge()
+	{
+		charging = true;
+		chargeTick = level_tick;
+		inputLog.push_back({sInputEvent::CHARGE, level_tick, ZL_Vector::Zero, ZL_Vector::Zero, false});
+	}
 
-	colSkyTop = ZL_Color::Lerp(colSkyTop, colSkyTopTarget, .1f);
-	colSkyBottom = ZL_Color::Lerp(colSkyBottom, colSkyBottomTarget, .1f);
-	ZL_Display::FillGradient(-10000, -5, 10000, ZL_Display::ScreenToWorld(0,ZLHEIGHT).y, colSkyTop, colSkyTop, colSkyBottom, colSkyBottom);
+	void Release()
+	{
+		charging = false;
+		inputLog.push_back({sInputEvent::RELEASE, level_tick, ZL_Vector::Zero, ZL_Vector::Zero, false});
+	}
 
-	// Calculate pointer position with transformed camera
-	ZL_Vector pointerInWorld = ZL_Display::ScreenToWorld(ZL_Input::Pointer());
-	float moveY = ZL_Math::Clamp1(((ZL_Input::Held(ZLK_W) || ZL_Input::Held(ZLK_UP)) ? 1.f : 0.f)
-				+ ((ZL_Input::Held(ZLK_S) || ZL_Input::Held(ZLK_DOWN)) ? -1.f : 0.f)
-				+ ((ZL_Input::Held(ZL_BUTTON_RIGHT) && sabs(pointerInWorld.y - CannonY) > 10 ) ? (pointerInWorld.y > CannonY ? 1.f : -1.f) : 0.f));
-	if (moveY)
+	// A single shot ends the charge and leaves from the cannon with the speed it charged up to
+	bool CanFire(const ZL_Vector& pos, const ZL_Vector& vel) const
 	{
-		CannonY = ZL_Math::Max(50.0f, CannonY + moveY * ZLELAPSEDF(250));
+		return (charging && pos.x == 0 && pos.y >= CANNON_MIN_Y && sabs(vel.GetLength() - ChargedSpeed()) < 1.0f);
 	}
 
-	// Draw Shadows
-	for (sThing t : things)
+	void Fire(const ZL_Vector& pos, const ZL_Vector& vel)
 	{
-		#define THING_SHADOW(p) p.x + 5, p.y - 5
-		if (t.type == sThing::FLOOR || t.type == sThing::WALL)
-		{
-			cpSplittingPlane *p = ((cpPolyShape *)t.body->shapeList)->planes;
-			ZL_Display::FillQuad(THING_SHADOW(p[0].v0), THING_SHADOW(p[1].v0), THING_SHADOW(p[2].v0), THING_SHADOW(p[3].v0), ZLLUMA(0, 0.5));
-		}
-		else if (t.type == sThing::NERD)
-			srfNerd.Draw(THING_SHADOW(t.body->p), t.body->a, ZLLUMA(0, 0.5));
-		else if (t.type == sThing::SUMO)
-			srfSumo.Draw(THING_SHADOW(t.body->p), t.body->a, (t.body->p.x > 0 ? -srfSumo.GetScaleW() : srfSumo.GetScaleW()), srfSumo.GetScaleH(), ZLLUMA(0, 0.5));
+		charging = false;
+		FireNerd(pos, vel);
 	}
 
-	// Draw grass grounds
-	srfGround.DrawTo(-10000, -64, 10000, 00);
-	for (int deck = 1; deck < level_decks; deck++)
+	// A rapid fire volley is three nerds side by side around the cannon, fanned out around the aim direction, at most one per RAPIDFIRE_INTERVAL while charging
+	bool CanFireVolley(const sInputEvent* shots) const
 	{
-		if (level_sides & 1) srfGround.DrawTo(200, level_decky[deck]-64, 10000, level_decky[deck]);
-		if (level_sides & 2) srfGround.DrawTo(-10000, level_decky[deck]-64, -200, level_decky[deck]);
+		if (!charging || level_tick < volleyTick + RAPIDFIRE_TICKS) return false;
+		const ZL_Vector &center = shots[1].pos, side = center - shots[0].pos;
+		if (center.x != 0 || center.y < CANNON_MIN_Y || sabs(side.GetLength() - RAPIDFIRE_OFFSET) > .01f) return false;
+		float aim = side.GetAngle() - PIHALF, speed = shots[1].vel.GetLength();
+		if (speed < 99.0f || speed > ChargedSpeed() + 1.0f) return false;
+		for (int n = -1; n <= 1; n++)
+		{
+			const sInputEvent& shot = shots[n + 1];
+			if (shot.type != sInputEvent::FIRE || !shot.rapid || shot.tick != level_tick) return false;
+			if ((shot.pos - (center + side * (scalar)n)).GetLength() > .01f || sabs(shot.vel.GetLength() - speed) > 1.0f) return false;
+			ZL_Vector dir = ZL_Vector::FromAngle(aim + RAPIDFIRE_SPREAD * n);
+			if (sabs(satan2(dir.x * shot.vel.y - dir.y * shot.vel.x, dir.x * shot.vel.x + dir.y * shot.vel.y)) > RAPIDFIRE_SPREAD * .5f + .001f) return false;
+		}
+		return true;
 	}
 
-	// Draw shoot line
-	ZL_Vector cannonDir = (pointerInWorld - ZLV(0, CannonY)).Norm();
-	if (cannonDir.y < .25f) { cannonDir.x = (cannonDir.x < 0 ? -1.0f : 1.0f); cannonDir.y = .25f; cannonDir.Norm(); }
-	if (ZL_Input::Held() && CannonRange)
+	void FireVolley(const sInputEvent* shots)
 	{
-		CannonVel = cannonDir * CannonRange;
-		ZL_Display::DrawWideLine(ZLV(0, CannonY), ZLV(0, CannonY) + CannonVel.VecWithLength(50.0f+CannonRange*.1f), 5.0f, ZL_Color::White, ZL_Color::White);
+		volleyTick = level_tick;
+		for (int i = 0; i != 3; i++) FireNerd(shots[i].pos, shots[i].vel, true);
 	}
-	if (ZL_Input::Up())
+
+	void FreeSpace()
 	{
-		linepos = ZL_Display::WorldToScreen(ZLV(0, CannonY - 50));
-		if (linepos.x > ZLFROMW(50)) linepos.x = ZLFROMW(50);
-		if (linepos.x < 50) linepos.x = 50;
-		if (linepos.y < 50) linepos.y = 50;
+		if (!space) return;
+		while (things.size()) RemoveThing(things.size()-1);
+		while (ground->shapeList)
+		{
+			cpShape* groundshape = ground->shapeList;
+			cpSpaceRemoveShape(space, groundshape);
+			cpShapeFree(groundshape);
+		}
+		cpSpaceRemoveBody(space, ground);
+		cpBodyFree(ground);
+		cpSpaceFree(space);
+		space = NULL;
 	}
 
-	// Draw all things
-	for (sThing t : things)
+	// Replace the contents of the space with a level snapshot, used for building levels and for simulations on copies
+	void LoadSnapshot(const sLevelSnapshot& snap)
 	{
-		cpSplittingPlane *planes = ((cpPolyShape *)t.body->shapeList)->planes;
-		if (t.type == sThing::WALL) srfWood.DrawQuad(planes[0].v0, planes[1].v0, planes[2].v0, planes[3].v0);
-		if (t.type == sThing::FLOOR) srfMetal.DrawQuad(planes[0].v0, planes[1].v0, planes[2].v0, planes[3].v0);
-		if (t.type == sThing::NERD)
+		// Every level runs on a fresh space so its simulation only depends on the level seed and the shots
+		FreeSpace();
+		space = NewGameSpace(CollisionTowerToSumo, this);
+		ground = cpSpaceAddBody(space, cpBodyNewStatic());
+		for (const cpBB& bb : snap.grounds)
 		{
-			srfNerd.Draw(t.body->p.x, t.body->p.y, t.body->a);
-			srfNerdShirt.Draw(t.body->p.x, t.body->p.y, t.body->a, t.color);
+			cpShape* groundshape = cpSpaceAddShape(space, cpBoxShapeNew2(ground, bb, 0));
+			cpShapeSetFriction(groundshape, 100);
 		}
-		if (t.type == sThing::SUMO)
+		for (const sLevelSnapshot::sBody& sb : snap.bodies)
 		{
-			srfSumo.Draw(t.body->p.x, t.body->p.y, t.body->a, (t.body->p.x > 0 ? -srfSumo.GetScaleW() : srfSumo.GetScaleW()), srfSumo.GetScaleH());
-			srfSumoPants.Draw(t.body->p.x, t.body->p.y, t.body->a, (t.body->p.x > 0 ? -srfSumo.GetScaleW() : srfSumo.GetScaleW()), srfSumo.GetScaleH(), t.color);
+			cpBody *b = AddLevelBody(space, sb.type, sb.width, sb.height);
+			cpBodySetPosition(b, sb.p);
+			if (sb.v != cpvzero) cpBodySetVelocity(b, sb.v);
+			if (sb.a) cpBodySetAngle(b, sb.a);
+			if (sb.w) cpBodySetAngularVelocity(b, sb.w);
+			AddThing(b, sb.type, (sb.type == sThing::SUMO ? RandomColor() : ZLWHITE));
+			if (sb.type == sThing::NERD) live_nerds++;
 		}
+		level_sides = snap.sides;
+		level_decks = snap.decks;
+		level_width = snap.width;
+		level_height = snap.height;
+		memcpy(level_decky, snap.decky, sizeof(level_decky));
+		total_sumos = remain_sumos = snap.sumos;
+		knocked = 0;
+		level_tick = 0;
+		inputLog.clear();
+		result = PLAYING;
+		charging = false;
+		volleyTick = -RAPIDFIRE_TICKS;
 	}
 
-	// Draw cannon base and cannon
-	float throwAngle = cannonDir.GetAngle();
-	ZL_Display::FillRect(-25.0f, 0.0f, 25.0f, CannonY, ZL_Color::Black);
-	srfCannon.Draw(0.0f, CannonY, throwAngle, srfCannon.GetScaleW(), (cannonDir.x < 0 ? -srfCannon.GetScaleH() : srfCannon.GetScaleH()));
-
-	#ifdef ZILLALOG //DEBUG DRAW
-	if (ZL_Display::KeyDown[ZLK_LSHIFT])
+	void TakeSnapshot(sLevelSnapshot& snap) const
 	{
-		ZL_Display::DrawLine(-10000, 0, 10000, 0, ZL_Color::Gray);
-		ZL_Display::DrawLine(0, -10000, 0, 10000, ZL_Color::Gray);
-		ZL_Display::DrawLine(-10000, level_height, 10000, level_height, ZL_Color::Gray);
-		ZL_Display::DrawLine(level_width, -10000, level_width, 10000, ZL_Color::Gray);
-		ZL_Display::DrawLine(-level_width, -10000, -level_width, 10000, ZL_Color::Gray);
-		void DebugDrawShape(cpShape*,void*); cpSpaceEachShape(space, DebugDrawShape, NULL);
-		void DebugDrawConstraint(cpConstraint*, void*); cpSpaceEachConstraint(space, DebugDrawConstraint, NULL);
+		snap.bodies.clear();
+		snap.grounds.clear();
+		snap.sumos = 0;
+		for (const sThing& t : things)
+		{
+			if (t.type == sThing::SUMO) snap.sumos++;
+			// The untransformed box vertices are stored after the transformed ones
+			cpPolyShape *poly = (cpPolyShape *)t.body->shapeList;
+			cpVect local = poly->planes[poly->count].v0;
+			snap.bodies.push_back({t.type, t.body->p, t.body->v, t.body->a, t.body->w, sabs(local.x)*2, sabs(local.y)*2});
+		}
+		for (cpShape* groundshape = ground->shapeList; groundshape; groundshape = groundshape->next)
+			snap.grounds.push_back(groundshape->bb);
+		snap.sides = level_sides;
+		snap.decks = level_decks;
+		snap.width = level_width;
+		snap.height = level_height;
+		memcpy(snap.decky, level_decky, sizeof(level_decky));
 	}
-	#endif
 
-	particleSmoke.Draw();
+	void BuildLevel(int goto_level, unsigned int seed = 0)
+	{
+		level = ZL_Math::Clamp(goto_level, 0, (int)(COUNT_OF(LevelSettings) + COUNT_OF(SandboxSettings)) - 1);
+		level_seed = (seed ? seed : (unsigned int)RAND_INT_RANGE(1, 0x7FFFFFFF));
 
-	ZL_Display::PopMatrix();
+		colorRnd = ZL_SeededRand(level_seed);
 
-	if (lineticks && ZLSINCE(lineticks) < 1000)
+		sLevelSnapshot snap;
+		GenerateLevel(level, level_seed, snap);
+		LoadSnapshot(snap);
+		remainTicks = LEVEL_TIME(level);
+	}
+
+	// One fixed physics tick followed by the rules checked after every tick (in reverse order so replays give the same result)
+	void Step()
+	{
+		if (profiler)
+		{
+			double start = PerfMs();
+			cpSpaceStep(space, PHYSICS_STEP);
+			profiler->Record(space, level_tick, (float)(PerfMs() - start), beginCalls);
+		}
+		else cpSpaceStep(space, PHYSICS_STEP);
+		beginCalls = 0;
+		level_tick++;
+		#ifdef HAS_THREADS
+		if (parallel && things.size() >= JOB_MIN_ITEMS)
+		{
+			// Check all things on the job system first, then do the removals in the same order as below
+			rules.resize(things.size());
+			Jobs.ParallelFor(things.size(), [this](size_t from, size_t to) { for (size_t i = from; i != to; i++) rules[i] = CheckRules(things[i]); });
+			for (size_t i = things.size(); i--;) if (rules[i] != KEEP) RemoveThing(i, rules[i] == KNOCKOUT);
+			return;
+		}
+		#endif
+		for (size_t i = things.size(); i--;)
+		{
+			eRule rule = CheckRules(things[i]);
+			if (rule != KEEP) RemoveThing(i, rule == KNOCKOUT);
+		}
+	}
+
+	eRule CheckRules(const sThing& t) const
 	{
-		txtBuf.SetText(lastline);
-		DrawTextBordered(txtBuf, linepos, 0.5f, ZLWHITE, ZLBLACK, 2, (linepos.x < ZLHALFH/2 ? ZL_Origin::CenterLeft : (linepos.x > ZLHALFH*3/2 ? ZL_Origin::CenterRight : ZL_Origin::Center)));
+		if (t.type == sThing::SUMO && IsSumoKnockedOut(t.body)) return KNOCKOUT;
+		if (t.type == sThing::NERD && IsNerdLost(t.body, level_width)) return REMOVE;
+		return KEEP;
 	}
 
-	txtBuf.SetText(0.5f, ZL_String::format("LEVEL\n%d", level+1));
-	DrawTextBordered(txtBuf, ZLV(10, ZLFROMH(50)), 1, ZLWHITE, ZLBLACK, 2, ZL_Origin::TopLeft);
-	txtBuf.SetText(0.5f, ZL_String::format("TIME\n%d", ZL_Math::Max(0, (int)((999+remainTicks)/1000))));
-	DrawTextBordered(txtBuf, ZLV(ZLHALFW, ZLFROMH(50)), 1, ZLWHITE, ZLBLACK, 2, ZL_Origin::TopCenter);
-	txtBuf.SetText(0.5f, ZL_String::format("REMAINING\n%d OF %d", remain_sumos, total_sumos));
-	DrawTextBordered(txtBuf, ZLV(ZLFROMW(10), ZLFROMH(50)), 1, ZLWHITE, ZLBLACK, 2, ZL_Origin::TopRight);
+	// Count the sumos and sum up the squared velocities of everything still moving inside the level
+	void Scan(size_t from, size_t to, sScan& res) const
+	{
+		res.sumos = 0;
+		res.remainvel = 0;
+		for (size_t i = from; i != to; i++)
+		{
+			const sThing& t = things[i];
+			if (t.type == sThing::SUMO)
+				res.sumos++;
+			else if (sabs(t.body->p.x) < level_width + 500.0f && t.body->p.y > 0.0f)
+				res.remainvel += cpvlengthsq(t.body->v);
+		}
+	}
 
-	if (ticksClear)
+	// Scan all things in chunks of JOB_GRAIN and add up the chunks in order, the float sum is the same with and without the job system
+	void ScanAll(sScan& res)
 	{
-		if (level == COUNT_OF(LevelSettings)-1)
-			txtBuf.SetText(0.5f, ZL_String::format("YOU FINISHED THE GAME!\n\nTHANKS FOR PLAYING!!\n\nCLICK TO GO BACK TO THE TITLE"));
+		scans.resize((things.size() + JOB_GRAIN - 1) / JOB_GRAIN);
+		auto scanChunks = [this](size_t from, size_t to) { for (size_t i = from; i < to; i += JOB_GRAIN) Scan(i, ZL_Math::Min(i + JOB_GRAIN, to), scans[i / JOB_GRAIN]); };
+		#ifdef HAS_THREADS
+		if (parallel && things.size() >= JOB_MIN_ITEMS) Jobs.ParallelFor(things.size(), scanChunks);
 		else
-			txtBuf.SetText(0.5f, ZL_String::format("LEVEL CLEARED!\n\nCLICK TO CONTINUE"));
-		DrawTextBordered(txtBuf, ZLV(ZLHALFW, ZLHALFH), 1.0f, ZL_Color::Green);
+		#endif
+		scanChunks(0, things.size());
+		res.sumos = 0;
+		res.remainvel = 0;
+		for (const sScan& part : scans) { res.sumos += part.sumos; res.remainvel += part.remainvel; }
 	}
 
-	if (ticksFailed)
+	float RemainVelocity()
 	{
-		txtBuf.SetText(0.5f, ZL_String::format("LEVEL FAILED!\n\nCLICK TO RETRY"));
-		DrawTextBordered(txtBuf, ZLV(ZLHALFW, ZLHALFH), 1.0f, ZL_Color::Orange);
+		sScan res;
+		ScanAll(res);
+		return res.remainvel;
 	}
-}
 
-static struct sAngryNerds : public ZL_Application
-{
-	sAngryNerds() : ZL_Application(60) { }
+	// The level ends after the tick when all sumos are gone or, once the time is up, when everything settled and the cannon isn't charging.
+	// Decided after every physics tick so the game and the verifier of claims end a level on the same tick.
+	void UpdateResult()
+	{
+		if (result != PLAYING) return;
+		remainTicks = ZL_Math::Max(0, LEVEL_TIME(level) - level_tick * PHYSICS_TICK);
+		if (knocked == total_sumos) result = CLEARED;
+		else if (!remainTicks && !charging && RemainVelocity() < 500.0f) result = FAILED;
+	}
 
-	virtual void Load(int argc, char *argv[])
+	// Count the remaining sumos and return the squared velocities of everything still moving
+	float CountRemaining()
 	{
-		if (!ZL_Application::LoadReleaseDesktopDataBundle()) return;
-		if (!ZL_Display::Init("Angry Nerds", 1280, 720, ZL_DISPLAY_ALLOWRESIZEHORIZONTAL)) return;
-		ZL_Display::ClearFill(ZL_Color::White);
-		ZL_Display::SetAA(true);
-		ZL_Audio::Init();
-		ZL_Input::Init();
+		sScan res;
+		ScanAll(res);
+		remain_sumos = res.sumos;
+		return res.remainvel;
+	}
 
-		ts = tinysam_create();
-		tinysam_set_output(ts, TINYSAM_STEREO_INTERLEAVED, 44100, .5f);
-		tinysam_set_speed(ts, 100);
-		tinysam_speak_english(ts, "Welcome to Angry Nerds");
+	static void PostStepRemoveBody(cpSpace *space, cpBody* body, sSession* session)
+	{
+		for (size_t i = session->things.size(); i--;) { if (session->things[i].body == body) { session->RemoveThing(i, true); return; } }
+	}
+
+	static cpBool CollisionTowerToSumo(cpArbiter *arb, cpSpace *space, cpDataPointer userData)
+	{
+		CP_ARBITER_GET_BODIES(arb, bTower, bSumo);
+		ZL_ASSERT(bTower->shapeList->type == COLLISION_TOWER && bSumo->shapeList->type == COLLISION_SUMO);
+		((sSession*)userData)->beginCalls++;
+		if (bSumo->p.y - 30.0f > bTower->p.y) return cpTrue;
+		cpSpaceAddPostStepCallback(space, (cpPostStepFunc)PostStepRemoveBody, bSumo, userData);
+		return cpTrue;
+	}
+
+	private: sSession(const sSession&); sSession& operator=(const sSession&); //the space keeps a pointer to the session
+};
+
+// The session that is played and shown on screen
+static sSession Game(true);
+
+// Trace the predicted flight arc of a nerd up to its first impact, using the closed form of the
+// fixed step integration done by chipmunk (p += v*dt after v += g*dt) and segment queries along it
+static bool TraceTrajectory(cpSpace *space, const ZL_Vector& pos, const ZL_Vector& vel, std::vector<ZL_Vector>& points)
+{
+	static const cpShapeFilter filterNoNerds = cpShapeFilterNew(CP_NO_GROUP, CP_ALL_CATEGORIES, ~(cpBitmask)CATEGORY_NERD);
+	points.clear();
+	points.push_back(pos);
+	for (int i = 1; i <= TRAJECTORY_SEGMENTS; i++)
+	{
+		float t = i * TRAJECTORY_SEGMENT_TIME;
+		ZL_Vector p(pos.x + vel.x * t, pos.y + vel.y * t + .5f * WORLD_GRAVITY * t * (t + PHYSICS_STEP));
+		cpSegmentQueryInfo hit;
+		if (cpSpaceSegmentQueryFirst(space, ZLV2CPV(points.back()), ZLV2CPV(p), 0, filterNoNerds, &hit))
+		{
+			points.push_back(hit.point);
+			return true;
+		}
+		points.push_back(p);
+	}
+	return false;
+}
+
+static void DrawTrajectory(const std::vector<ZL_Vector>& points, bool hit, const ZL_Color& col)
+{
+	for (size_t i = 1; i < points.size(); i++)
+		if ((i & 1) || (hit && i == points.size() - 1)) { ZL_Display::DrawWideLine(points[i-1], points[i], 3.0f, col, col); RenderStats.Add(4); }
+	if (hit) { ZL_Display::FillCircle(points.back(), 8.0f, col); RenderStats.Add(0); } //circle vertex count is up to ZillaLib
+}
+
+static void SpeakRandomLine()
+{
+	TSMTXLOCK();
+	tinysam_reset(Game.ts);
+	lastline = RAND_ARRAYELEMENT(lines);
+	tinysam_speak_english(Game.ts, lastline);
+	lineticks = ZLTICKS;
+	TSMTXUNLOCK();
+}
+
+static float SandboxMemoryMB()
+{
+	// Approximation of the memory held by the level (thing list, chipmunk bodies and shapes, without broadphase and arbiters)
+	return (Game.things.capacity() * sizeof(sThing) + Game.things.size() * (sizeof(cpBody) + sizeof(cpPolyShape))) / (1024.0f * 1024.0f);
+}
+
+// Random cannon height and velocity aimed at a side of the level where towers are
+static ZL_Vector RandomShot(ZL_SeededRand& rnd, int sides, float height, float& cannonY)
+{
+	cannonY = rnd.Range(50.0f, ZL_Math::Max(150.0f, height));
+	float side = (sides == 3 ? (rnd.Range(0.0f, 1.0f) < .5f ? -1.0f : 1.0f) : ((sides & 1) ? 1.0f : -1.0f));
+	float angle = rnd.Range(.26f, PIHALF - .05f), power = rnd.Range(100.0f, 2500.0f);
+	return ZL_Vector(side * scos(angle), ssin(angle)) * power;
+}
+
+#define HINT_SIM_TICKS (3000/PHYSICS_TICK)
+#define HINT_BATCH_TICKS 8
+#define HINT_BUSY_MS 2.0
+#define HINT_IDLE_MS 2
+
+// Background search for a good shot on a snapshot of the current level while the player aims
+static struct sHintSolver
+{
+	sLevelSnapshot snapshot;
+	unsigned int seed;
+	bool found;
+	int score;
+	float cannonY;
+	ZL_Vector vel;
+	#ifdef HAS_THREADS
+	std::thread thread;
+	std::atomic<bool> abort;
+	std::mutex mtx;
+	~sHintSolver() { abort = true; if (thread.joinable()) thread.join(); }
+	#endif
+} Hint;
+
+#ifdef HAS_THREADS
+static void HintSolverThread()
+{
+	ZL_SeededRand rnd(Hint.seed);
+	sSession sim;
+	double busyStart = PerfMs();
+	while (!Hint.abort)
+	{
+		float cannonY;
+		ZL_Vector vel = RandomShot(rnd, Hint.snapshot.sides, Hint.snapshot.height, cannonY);
+
+		sim.LoadSnapshot(Hint.snapshot);
+		sim.FireNerd(ZLV(0, cannonY), vel);
+		for (int i = 0; i != HINT_SIM_TICKS && !Hint.abort; i++)
+		{
+			sim.Step();
+			if ((i % HINT_BATCH_TICKS) != HINT_BATCH_TICKS - 1 || PerfMs() - busyStart < HINT_BUSY_MS) continue;
+
+			// Throttled to about half of a core, after every HINT_BUSY_MS of simulation the search sleeps for HINT_IDLE_MS
+			std::this_thread::sleep_for(std::chrono::milliseconds(HINT_IDLE_MS));
+			busyStart = PerfMs();
+		}
+
+		bool done = false;
+		if (!Hint.abort && sim.knocked > Hint.score)
+		{
+			std::lock_guard<std::mutex> lock(Hint.mtx);
+			Hint.found = true;
+			Hint.score = sim.knocked;
+			Hint.cannonY = cannonY;
+			Hint.vel = vel;
+			done = (sim.knocked >= Hint.snapshot.sumos);
+		}
+		if (done) break;
+	}
+}
+#endif
+
+static void StopHintSolver()
+{
+	#ifdef HAS_THREADS
+	if (Hint.thread.joinable())
+	{
+		Hint.abort = true;
+		Hint.thread.join();
+	}
+	Hint.found = false;
+	#endif
+}
+
+static void StartHintSolver()
+{
+	#ifdef HAS_THREADS
+	StopHintSolver();
+	Game.TakeSnapshot(Hint.snapshot);
+	Hint.seed = Game.level_seed + Game.level_tick;
+	Hint.score = 0;
+	Hint.abort = false;
+	Hint.thread = std::thread(HintSolverThread);
+	#endif
+}
+
+#ifdef HAS_HEADLESS
+// One fixed physics tick followed by the level result like the game runs it, returns false once the level ended
+static bool TickSession(sSession& game)
+{
+	game.Step();
+	game.UpdateResult();
+	return (game.result == sSession::PLAYING);
+}
+
+// Ticks the cannon needs to be held to charge up to the speed of a shot and to move between two heights
+static int ShotChargeTicks(const ZL_Vector& vel) { return ZL_Math::Clamp((int)((vel.GetLength() - 100.0f) / PHYSICS_TICK + .999f), 0, (2500 - 100) / PHYSICS_TICK); }
+static int CannonMoveTicks(float fromY, float toY) { return (int)(sabs(toY - fromY) / (CANNON_MOVE_SPEED * PHYSICS_TICK / 1000.0f) + .999f); }
+
+// Play a single shot with the input rules of the game, the cannon moves to targetY while charging for as long as the speed of vel needs
+// Returns false if the level ended before the shot or the shot got rejected, when the time runs out it gets fired early like in the game
+static bool PlayShot(sSession& game, float& cannonY, float targetY, const ZL_Vector& vel)
+{
+	int chargeTicks = ShotChargeTicks(vel);
+	for (int i = CannonMoveTicks(cannonY, targetY) - chargeTicks; i > 0; i--) if (!TickSession(game)) return false;
+	if (!game.CanCharge()) return false;
+	game.Charge();
+	for (int i = 0; i != chargeTicks && game.remainTicks; i++) if (!TickSession(game)) return false;
+	cannonY = targetY;
+	ZL_Vector pos(0, cannonY), shot = vel.VecWithLength(game.ChargedSpeed());
+	if (!game.CanFire(pos, shot)) { game.Release(); return false; }
+	game.Fire(pos, shot);
+	return true;
+}
+#endif
+
+#ifdef HAS_VERIFIER
+// A level clear claim is a text file with the level index (0 based), the level seed and the input of the level:
+//   level <index>
+//   seed <seed>
+//   charge <tick>
+//   release <tick>
+//   shot <tick> <x> <y> <velocity x> <velocity y> <rapid>
+struct sClaim { int level; unsigned int seed; std::vector<sInputEvent> inputs; };
+static const char* claimDir;
+
+static bool WriteClaim(const char* path, const sClaim& claim)
+{
+	FILE* f = fopen(path, "w");
+	if (!f) return false;
+	fprintf(f, "level %d\nseed %u\n", claim.level, claim.seed);
+	for (const sInputEvent& e : claim.inputs)
+	{
+		if (e.type == sInputEvent::CHARGE) fprintf(f, "charge %d\n", e.tick);
+		else if (e.type == sInputEvent::RELEASE) fprintf(f, "release %d\n", e.tick);
+		else fprintf(f, "shot %d %.9g %.9g %.9g %.9g %d\n", e.tick, e.pos.x, e.pos.y, e.vel.x, e.vel.y, (int)e.rapid);
+	}
+	fclose(f);
+	return true;
+}
+
+static bool ReadClaim(const char* path, sClaim& claim)
+{
+	FILE* f = fopen(path, "r");
+	if (!f) return false;
+	bool ok = (fscanf(f, " level %d seed %u", &claim.level, &claim.seed) == 2);
+	for (sInputEvent e = { sInputEvent::FIRE, 0, ZL_Vector::Zero, ZL_Vector::Zero, false }; ok; claim.inputs.push_back(e))
+	{
+		char type[8];
+		int rapid, res = fscanf(f, " %7s %d", type, &e.tick);
+		if (res == EOF) break;
+		ok = (res == 2);
+		if (ok && !strcmp(type, "charge")) e.type = sInputEvent::CHARGE;
+		else if (ok && !strcmp(type, "release")) e.type = sInputEvent::RELEASE;
+		else if (ok && !strcmp(type, "shot"))
+		{
+			e.type = sInputEvent::FIRE;
+			ok = (fscanf(f, "%f %f %f %f %d", &e.pos.x, &e.pos.y, &e.vel.x, &e.vel.y, &rapid) == 5);
+			e.rapid = !!rapid;
+		}
+		else ok = false;
+	}
+	fclose(f);
+	return ok;
+}
+
+#define VERIFY_SETTLE_TICKS (60000/PHYSICS_TICK)
+
+// Re-simulate a claim in fixed ticks like the game does, applying the input with the same rules, returns NULL if the level got cleared or the reason for failing
+static const char* VerifyClaim(const sClaim& claim, int& ticks)
+{
+	ticks = 0;
+	if (claim.level < 0 || claim.level >= (int)(COUNT_OF(LevelSettings) + COUNT_OF(SandboxSettings))) return "invalid level";
+	int timeTicks = LEVEL_TIME(claim.level) / PHYSICS_TICK;
+	for (size_t i = 0; i != claim.inputs.size(); i++)
+		if (claim.inputs[i].tick < 0 || (i && claim.inputs[i].tick < claim.inputs[i-1].tick)) return "invalid input tick";
+
+	sSession sim;
+	sim.BuildLevel(claim.level, claim.seed);
+	for (size_t next = 0; ticks != timeTicks + VERIFY_SETTLE_TICKS; ticks++)
+	{
+		for (; next != claim.inputs.size() && claim.inputs[next].tick == ticks; next++)
+		{
+			const sInputEvent& e = claim.inputs[next];
+			if (e.type == sInputEvent::CHARGE) { if (!sim.CanCharge()) return "invalid charge"; sim.Charge(); }
+			else if (e.type == sInputEvent::RELEASE) { if (!sim.CanRelease()) return "invalid release"; sim.Release(); }
+			else if (!e.rapid) { if (!sim.CanFire(e.pos, e.vel)) return "invalid shot"; sim.Fire(e.pos, e.vel); }
+			else if (next + 3 > claim.inputs.size() || !sim.CanFireVolley(&e)) return "invalid rapid fire";
+			else { sim.FireVolley(&e); next += 2; }
+		}
+		sim.Step();
+		sim.UpdateResult();
+		if (sim.result == sSession::CLEARED) return NULL;
+		if (sim.result == sSession::FAILED) return "sumos remaining";
+	}
+	return "sumos remaining";
+}
+
+// Verify all claim files in a directory in parallel and print the result and simulation time of each
+static int RunVerifier(const char* dir, int numThreads)
+{
+	std::vector<std::string> files;
+	if (DIR* d = opendir(dir))
+	{
+		while (dirent* e = readdir(d)) if (e->d_name[0] != '.') files.push_back(std::string(dir) + "/" + e->d_name);
+		closedir(d);
+	}
+	else { fprintf(stderr, "Could not open directory %s\n", dir); return 2; }
+	std::sort(files.begin(), files.end());
+
+	struct sResult { const char* error; int ticks; double ms; };
+	std::vector<sResult> results(files.size());
+	std::atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for (size_t i; (i = next++) < files.size();)
+		{
+			double start = PerfMs();
+			sClaim claim;
+			results[i].ticks = 0;
+			results[i].error = (ReadClaim(files[i].c_str(), claim) ? VerifyClaim(claim, results[i].ticks) : "unreadable claim");
+			results[i].ms = PerfMs() - start;
+		}
+	};
+
+	double start = PerfMs();
+	if (numThreads <= 0) numThreads = ZL_Math::Max(1, (int)std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; i++) threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads) t.join();
+	double total = PerfMs() - start;
+
+	int passed = 0;
+	for (size_t i = 0; i != files.size(); i++)
+	{
+		if (!results[i].error) passed++;
+		printf("%s: %s%s%s - %d ticks - %.2f ms\n", files[i].c_str(), (results[i].error ? "FAIL (" : "PASS"), (results[i].error ? results[i].error : ""), (results[i].error ? ")" : ""), results[i].ticks, results[i].ms);
+	}
+	printf("%d of %d claims passed in %.0f ms with %d threads (%.0f per minute)\n", passed, (int)files.size(), total, numThreads, (total > 0 ? files.size() * 60000.0 / total : 0.0));
+	return (passed == (int)files.size() ? 0 : 1);
+}
+
+#define REPLAYTEST_VOLLEYS 6
+
+// Self test of the claim replays: plays levels one after another on a single session like the game does, so pooled nerds
+// carry over between levels, with single shots and rapid fire volleys, and checks that a fresh session replaying the input
+// of each level with VerifyClaim ends it with the same result on the same tick
+static int RunReplayTest(int numLevels, unsigned int seed)
+{
+	if (numLevels <= 0) numLevels = 20;
+	ZL_SeededRand rnd(seed ? seed : 1);
+	sSession game;
+	int passed = 0;
+	for (int n = 0; n != numLevels; n++)
+	{
+		game.BuildLevel(n % (int)COUNT_OF(LevelSettings), 1 + rnd.UInt() % 0x7FFFFFFE);
+		int timeTicks = LEVEL_TIME(game.level) / PHYSICS_TICK;
+		float cannonY = 150.0f;
+		for (int shot = 0; game.result == sSession::PLAYING && game.remainTicks; shot++)
+		{
+			float targetY;
+			ZL_Vector vel = RandomShot(rnd, game.level_sides, game.level_height, targetY);
+			if (shot % 3 != 2) { PlayShot(game, cannonY, targetY, vel); continue; }
+
+			// Every third shot is a charge with rapid fire volleys from where the cannon is, aimed like the random shot
+			if (!game.CanCharge()) break;
+			game.Charge();
+			ZL_Vector side = ZL_Vector(-vel.y, vel.x).VecWithLength(RAPIDFIRE_OFFSET);
+			for (int v = 0; v != REPLAYTEST_VOLLEYS && game.result == sSession::PLAYING && game.remainTicks; v++)
+			{
+				sInputEvent volley[3];
+				for (int i = -1; i <= 1; i++)
+				{
+					float angle = vel.GetAngle() + RAPIDFIRE_SPREAD * i + rnd.Range(-RAPIDFIRE_SPREAD * .4f, RAPIDFIRE_SPREAD * .4f);
+					volley[i + 1] = { sInputEvent::FIRE, game.level_tick, ZLV(0, cannonY) + side * (scalar)i, ZL_Vector::FromAngle(angle) * game.ChargedSpeed(), true };
+				}
+				if (game.CanFireVolley(volley)) game.FireVolley(volley);
+				for (int i = 0; i != RAPIDFIRE_TICKS && TickSession(game); i++) {}
+			}
+			if (game.CanRelease()) game.Release();
+		}
+		while (game.result == sSession::PLAYING && game.level_tick != timeTicks + VERIFY_SETTLE_TICKS) TickSession(game);
+
+		// The verifier counts the tick a level ended on, the session already moved past it
+		sClaim claim = { game.level, game.level_seed, game.inputLog };
+		int ticks, gameTicks = game.level_tick - (game.result == sSession::PLAYING ? 0 : 1);
+		const char* error = VerifyClaim(claim, ticks);
+		bool ok = ((error == NULL) == (game.result == sSession::CLEARED) && ticks == gameTicks);
+		if (ok) passed++;
+		printf("Level %d seed %u: %s - game %s on tick %d, replay %s on tick %d - %d inputs\n", game.level + 1, game.level_seed, (ok ? "PASS" : "FAIL"),
+			(game.result == sSession::CLEARED ? "cleared" : "failed"), gameTicks, (error ? error : "cleared"), ticks, (int)claim.inputs.size());
+	}
+	printf("%d of %d replays matched\n", passed, numLevels);
+	return (passed == numLevels ? 0 : 1);
+}
+#endif
+
+#ifdef HAS_HEADLESS
+#define HOST_SHOT_TICKS_MIN (1000/PHYSICS_TICK)
+#define HOST_SHOT_TICKS_MAX (3000/PHYSICS_TICK)
+
+// Headless load test hosting many sessions with a simple random shooting player each, spread over a pool of threads
+static int RunSessionHost(int numSessions, int numThreads, int seconds)
+{
+	struct sHostedSession
+	{
+		sSession session;
+		ZL_SeededRand rnd;
+		int nextShotTick, played, cleared;
+		sHostedSession(unsigned int seed) : rnd(seed), nextShotTick(0), played(0), cleared(0) { }
+		void StartLevel(int lvl) { session.BuildLevel(lvl, 1 + rnd.UInt() % 0x7FFFFFFE); nextShotTick = rnd.Int(HOST_SHOT_TICKS_MIN, HOST_SHOT_TICKS_MAX); }
+	};
+
+	if (numSessions <= 0) numSessions = 1;
+	if (numThreads <= 0) numThreads = ZL_Math::Max(1, (int)std::thread::hardware_concurrency());
+	if (seconds <= 0) seconds = 60;
+	int frames = seconds * 1000 / PHYSICS_TICK;
+
+	std::vector<sHostedSession*> sessions;
+	for (int i = 0; i != numSessions; i++) sessions.push_back(new sHostedSession(i + 1));
+
+	// Each thread owns every n-th session and runs it frame by frame with one physics tick per frame
+	auto worker = [&](int t)
+	{
+		for (int i = t; i < numSessions; i += numThreads)
+			sessions[i]->StartLevel(sessions[i]->rnd.Int(0, (int)COUNT_OF(LevelSettings) - 1));
+		for (int frame = 0; frame != frames; frame++)
+		{
+			for (int i = t; i < numSessions; i += numThreads)
+			{
+				sHostedSession& h = *sessions[i];
+				sSession& game = h.session;
+				game.Step();
+				game.UpdateResult();
+				if (game.result != sSession::PLAYING)
+				{
+					h.played++;
+					if (game.result == sSession::CLEARED) h.cleared++;
+					h.StartLevel(game.result == sSession::CLEARED ? (game.level + 1) % (int)COUNT_OF(LevelSettings) : game.level);
+				}
+				else if (game.level_tick >= h.nextShotTick && game.remainTicks)
+				{
+					float cannonY;
+					ZL_Vector vel = RandomShot(h.rnd, game.level_sides, game.level_height, cannonY);
+					game.FireNerd(ZLV(0, cannonY), vel);
+					h.nextShotTick = game.level_tick + h.rnd.Int(HOST_SHOT_TICKS_MIN, HOST_SHOT_TICKS_MAX);
+				}
+			}
+		}
+	};
+
+	double start = PerfMs();
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; i++) threads.emplace_back(worker, i);
+	worker(0);
+	for (std::thread& t : threads) t.join();
+	double total = PerfMs() - start;
+
+	int played = 0, cleared = 0;
+	for (sHostedSession* h : sessions) { played += h->played; cleared += h->cleared; delete h; }
+	double realtime = (total > 0 ? numSessions * seconds * 1000.0 / total : 0.0);
+	printf("%d sessions simulated %d seconds each in %.0f ms with %d threads\n", numSessions, seconds, total, numThreads);
+	printf("%d levels played, %d cleared - %.1f real time sessions total, %.1f per thread\n", played, cleared, realtime, realtime / numThreads);
+	return 0;
+}
+
+#define SOLVE_ATTEMPTS 4
+#define SOLVE_CANDIDATES 16
+#define SOLVE_SHOT_TICKS (1000/PHYSICS_TICK)
+#define SOLVE_SETTLE_TICKS (60000/PHYSICS_TICK)
+
+// Greedy search for shots that clear the level of a session, every shot is the best of a number of random candidates
+// simulated ahead on a copy of the current state and then played with the input rules of the game, including the time
+// to move and charge the cannon. Returns the number of shots used or 0 if the level wasn't cleared or the verifier
+// rejected the input of the clear.
+static int SolveLevel(sSession& game, sSession& sim, sLevelSnapshot& snap, ZL_SeededRand& rnd)
+{
+	int shots = 0;
+	float cannonY = 150.0f;
+	while (game.result == sSession::PLAYING && game.remainTicks)
+	{
+		game.TakeSnapshot(snap);
+		int bestScore = -1;
+		float bestY = 0;
+		ZL_Vector bestVel;
+		for (int c = 0; c != SOLVE_CANDIDATES; c++)
+		{
+			// Candidates leave after the cannon got moved and charged up, with the speed it can charge up to
+			float targetY;
+			ZL_Vector vel = RandomShot(rnd, snap.sides, snap.height, targetY);
+			int chargeTicks = ShotChargeTicks(vel);
+			sim.LoadSnapshot(snap);
+			for (int i = ZL_Math::Max(chargeTicks, CannonMoveTicks(cannonY, targetY)); i; i--) sim.Step();
+			sim.FireNerd(ZLV(0, targetY), vel.VecWithLength(CANNON_SPEED(chargeTicks)));
+			for (int i = 0; i != HINT_SIM_TICKS && sim.knocked != snap.sumos; i++) sim.Step();
+			if (sim.knocked > bestScore) { bestScore = sim.knocked; bestY = targetY; bestVel = vel; }
+		}
+
+		if (!PlayShot(game, cannonY, bestY, bestVel)) break;
+		shots++;
+		for (int i = 0; i != SOLVE_SHOT_TICKS && TickSession(game); i++) {}
+	}
+
+	// Like in the game the level still gets cleared after the time is up as long as things are moving
+	int endTick = LEVEL_TIME(game.level) / PHYSICS_TICK + SOLVE_SETTLE_TICKS;
+	while (game.result == sSession::PLAYING && game.level_tick < endTick) TickSession(game);
+	if (game.result != sSession::CLEARED) return 0;
+
+	#ifdef HAS_VERIFIER
+	sClaim claim = { game.level, game.level_seed, game.inputLog };
+	int ticks;
+	if (const char* error = VerifyClaim(claim, ticks))
+	{
+		fprintf(stderr, "Level %d seed %u: clear rejected by the verifier (%s)\n", game.level + 1, game.level_seed, error);
+		return 0;
+	}
+	#endif
+	return shots;
+}
+
+// Offline solvability check of the generated levels, searches clearing shots for seeds 1 to N of every level in parallel
+// and prints the solve rate over multiple search attempts and the minimum number of shots needed per seed as CSV
+static int RunSolver(int numSeeds, int numThreads)
+{
+	if (numSeeds <= 0) numSeeds = 100;
+	if (numThreads <= 0) numThreads = ZL_Math::Max(1, (int)std::thread::hardware_concurrency());
+
+	struct sResult { int solved, minShots; };
+	std::vector<sResult> results(COUNT_OF(LevelSettings) * numSeeds);
+	std::atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		sSession game, sim;
+		sLevelSnapshot snap;
+		for (size_t i; (i = next++) < results.size();)
+		{
+			int lvl = (int)(i / numSeeds);
+			unsigned int seed = (unsigned int)(1 + i % numSeeds);
+			ZL_SeededRand rnd(seed * 7919 + lvl);
+			sResult& r = results[i];
+			r.solved = r.minShots = 0;
+			for (int attempt = 0; attempt != SOLVE_ATTEMPTS; attempt++)
+			{
+				game.BuildLevel(lvl, seed);
+				int shots = SolveLevel(game, sim, snap, rnd);
+				if (!shots) continue;
+				r.solved++;
+				if (!r.minShots || shots < r.minShots) r.minShots = shots;
+			}
+		}
+	};
+
+	double start = PerfMs();
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; i++) threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads) t.join();
+	double total = PerfMs() - start;
+
+	// Levels are numbered from 1 like in the game, a minimum of 0 shots means no attempt cleared the level
+	printf("level,seed,solve_rate,min_shots\n");
+	for (size_t i = 0; i != results.size(); i++)
+		printf("%d,%d,%.2f,%d\n", (int)(i / numSeeds) + 1, (int)(1 + i % numSeeds), results[i].solved / (float)SOLVE_ATTEMPTS, results[i].minShots);
+	for (int lvl = 0; lvl != (int)COUNT_OF(LevelSettings); lvl++)
+	{
+		int solvable = 0, solved = 0, shots = 0;
+		for (int i = lvl * numSeeds; i != (lvl + 1) * numSeeds; i++)
+		{
+			if (results[i].solved) { solvable++; shots += results[i].minShots; }
+			solved += results[i].solved;
+		}
+		fprintf(stderr, "Level %d: %d of %d seeds solvable - solve rate %.0f%% - average minimum shots %.1f\n", lvl + 1, solvable, numSeeds, solved * 100.0f / (numSeeds * SOLVE_ATTEMPTS), (solvable ? shots / (float)solvable : 0.0f));
+	}
+	fprintf(stderr, "Searched %d seeds in %.0f ms with %d threads\n", (int)results.size(), total, numThreads);
+	return 0;
+}
+#endif
+
+// Render state of the played session, published by the simulation after every update for Draw to read
+struct sFrame
+{
+	struct sItem { sThing::eType type; ZL_Color color; ZL_Vector p; const ZL_Vector* verts; float a; bool resting; };
+	std::vector<sItem> items; //ordered by grid cell
+	// Persistent vertex slot of each tower piece (by thing index), only rewritten when its body was replaced or moved since this frame was last published
+	struct sTowerSlot { const cpBody* body; ZL_Vector p; float a; ZL_Vector verts[4]; };
+	std::vector<sTowerSlot> tower;
+	int towerUpdates; //slots rewritten by the last publish
+	unsigned int restingKey; //changes whenever the set or the positions of the tower pieces at rest change
+	// Uniform grid over the items so Draw only visits the cells overlapping the view
+	float gridX, gridY, gridCell, itemRadius;
+	int gridW, gridH;
+	std::vector<unsigned int> cellStart; //first item of each cell, plus the end of the last cell
+	// Knocked out sumos not yet acknowledged by the main thread, tagged with the serial of the frame they were first published in
+	// (a frame that gets replaced before it was read doesn't lose them, they are published again until seen)
+	struct sKnockout { unsigned int serial; ZL_Vector p; };
+	std::vector<sKnockout> knockouts;
+	std::vector<ZL_Vector> trajectory, hintTrajectory;
+	bool trajectoryHit, hintFound, hintHit;
+	unsigned int serial;
+	int build, level, level_sides, level_decks, remain_sumos, total_sumos, live_nerds, remainTicks;
+	float cannonRange; //speed the cannon charged up to, 0 when not charging
+	float level_width, level_height, level_decky[10];
+	sSession::eResult result;
+	float stepMs, scanMs, memoryMB;
+	bool profiling;
+	sPhysicsProfiler::sSample profile;
+	sFrame() : towerUpdates(0), restingKey(0), gridX(0), gridY(0), gridCell(1), itemRadius(0), gridW(0), gridH(0), trajectoryHit(false), hintFound(false), hintHit(false), serial(0), build(0), level(0), level_sides(0), level_decks(0), remain_sumos(0), total_sumos(0), live_nerds(0), remainTicks(0),
+		cannonRange(0), level_width(0), level_height(0), result(sSession::PLAYING), stepMs(0), scanMs(0), memoryMB(0), profiling(false) { }
+};
+
+// Requests from the input handling to the simulation, everything touching the physics space is done by the simulation
+struct sSimCommand { enum eType { BUILD, CHARGE, RELEASE, FIRE, STOP_HINT } type; int level, build; unsigned int seed; ZL_Vector pos, vel; bool rapid; };
+struct sSimInput { bool running, charging, hints, profile; int speed; ZL_Vector aimPos, aimVel; };
+
+// The simulation of the played session. With threads it runs on its own thread and publishes frames into a double buffer,
+// the renderer marks the frame it reads and a publish which would overwrite that frame is skipped until the next update.
+static struct sSimulation
+{
+	sFrame frames[2];
+	std::vector<sSimCommand> commands, pendingCommands;
+	sSimInput input;
+	int build, tickSum;
+	int requestedBuild; //last level build sent by the input handling, frames of older builds don't end the level
+	unsigned int serial;
+	std::vector<sFrame::sKnockout> knockouts; //published knockouts kept until the main thread saw a frame with their serial
+	#ifdef HAS_THREADS
+	std::atomic<unsigned int> seenSerial;
+	std::atomic<int> published, reading;
+	std::mutex mtx, updateMtx;
+	std::atomic<bool> quit;
+	std::thread thread;
+	~sSimulation() { quit = true; if (thread.joinable()) thread.join(); }
+	#else
+	unsigned int seenSerial;
+	int published, reading;
+	#endif
+	sSimulation() : build(0), tickSum(0), requestedBuild(0), serial(0), seenSerial(0), published(0), reading(-1) { input = { false, false, false, false, 1, ZL_Vector::Zero, ZL_Vector::Zero }; }
+
+	void Send(const sSimCommand& cmd)
+	{
+		#ifdef HAS_THREADS
+		std::lock_guard<std::mutex> lock(mtx);
+		#endif
+		commands.push_back(cmd);
+	}
+
+	// Send multiple commands which are applied together in the same update
+	void Send(const sSimCommand* cmds, size_t count)
+	{
+		#ifdef HAS_THREADS
+		std::lock_guard<std::mutex> lock(mtx);
+		#endif
+		commands.insert(commands.end(), cmds, cmds + count);
+	}
+
+	void SetInput(const sSimInput& in)
+	{
+		#ifdef HAS_THREADS
+		std::lock_guard<std::mutex> lock(mtx);
+		#endif
+		input = in;
+	}
+
+	const sFrame& BeginRead()
+	{
+		int idx;
+		do { idx = published; reading = idx; } while (idx != published);
+		return frames[idx];
+	}
+
+	void EndRead() { reading = -1; }
+} Sim;
+
+static bool TraceTrajectory(cpSpace *space, const ZL_Vector& pos, const ZL_Vector& vel, std::vector<ZL_Vector>& points);
+
+static void PublishFrame(const sSimInput& input)
+{
+	int target = 1 - Sim.published;
+	if (Sim.reading == target) return; //still being drawn, publish on the next update
+
+	sFrame& f = Sim.frames[target];
+	size_t count = Game.things.size();
+	f.items.resize(count);
+	f.tower.resize(count, { NULL, ZL_Vector::Zero, 0, {} });
+	f.towerUpdates = 0;
+
+	// Bucket the things into the cells of a grid spanning all of them with a counting sort
+	ZL_Vector lo(0, 0), hi(0, 0);
+	for (const sThing& t : Game.things)
+	{
+		lo.x = ZL_Math::Min(lo.x, t.body->p.x); hi.x = ZL_Math::Max(hi.x, t.body->p.x);
+		lo.y = ZL_Math::Min(lo.y, t.body->p.y); hi.y = ZL_Math::Max(hi.y, t.body->p.y);
+	}
+	f.gridCell = ZL_Math::Max(256.0f, ZL_Math::Max(hi.x - lo.x, hi.y - lo.y) / 128.0f);
+	f.gridX = lo.x;
+	f.gridY = lo.y;
+	f.gridW = (int)((hi.x - lo.x) / f.gridCell) + 1;
+	f.gridH = (int)((hi.y - lo.y) / f.gridCell) + 1;
+	f.cellStart.assign(f.gridW * f.gridH + 1, 0);
+	static std::vector<unsigned int> cellOf, cursor;
+	cellOf.resize(count);
+	for (size_t i = 0; i != count; i++)
+	{
+		const cpVect& p = Game.things[i].body->p;
+		cellOf[i] = (unsigned int)((int)((p.x - f.gridX) / f.gridCell) + (int)((p.y - f.gridY) / f.gridCell) * f.gridW);
+		f.cellStart[cellOf[i] + 1]++;
+	}
+	for (size_t c = 1; c != f.cellStart.size(); c++) f.cellStart[c] += f.cellStart[c - 1];
+	cursor.assign(f.cellStart.begin(), f.cellStart.end() - 1);
+
+	float radiusSq = 46.0f*46.0f; //covers the largest sprite (the sumo scaled by 2)
+	f.restingKey = (unsigned int)count;
+	for (size_t i = 0; i != count; i++)
+	{
+		const sThing& t = Game.things[i];
+		sFrame::sItem& item = f.items[cursor[cellOf[i]]++];
+		item.type = t.type;
+		item.color = t.color;
+		item.p = t.body->p;
+		item.a = t.body->a;
+		item.verts = NULL;
+		item.resting = false;
+		if (t.type == sThing::FLOOR || t.type == sThing::WALL)
+		{
+			sFrame::sTowerSlot& slot = f.tower[i];
+			if (slot.body != t.body || slot.p != item.p || slot.a != item.a)
+			{
+				cpSplittingPlane *planes = ((cpPolyShape *)t.body->shapeList)->planes;
+				for (int j = 0; j != 4; j++) slot.verts[j] = planes[j].v0;
+				slot.body = t.body;
+				slot.p = item.p;
+				slot.a = item.a;
+				f.towerUpdates++;
+			}
+			item.verts = slot.verts;
+			radiusSq = ZL_Math::Max(radiusSq, (item.verts[0] - item.p).GetLengthSq());
+			item.resting = IsBodyResting(t.body);
+			if (item.resting) f.restingKey = f.restingKey * 31u + (unsigned int)((int)item.p.x * 7 + (int)item.p.y + (int)(item.a * 100.0f));
+		}
+	}
+	f.itemRadius = ssqrt(radiusSq);
+	for (const ZL_Vector& p : Game.knockouts) Sim.knockouts.push_back({Sim.serial + 1, p});
+	Game.knockouts.clear();
+	size_t unseen = 0;
+	for (const sFrame::sKnockout& k : Sim.knockouts) if (k.serial > Sim.seenSerial) Sim.knockouts[unseen++] = k;
+	Sim.knockouts.resize(unseen);
+	f.knockouts = Sim.knockouts;
+
+	f.trajectory.clear();
+	f.trajectoryHit = (input.charging && input.aimVel != ZL_Vector::Zero && TraceTrajectory(Game.space, input.aimPos, input.aimVel, f.trajectory));
+	f.hintFound = false;
+	#ifdef HAS_THREADS
+	if (input.hints)
+	{
+		Hint.mtx.lock();
+		bool hintFound = Hint.found;
+		ZL_Vector hintPos(0, Hint.cannonY), hintVel = Hint.vel;
+		Hint.mtx.unlock();
+		if (hintFound) { f.hintFound = true; f.hintHit = TraceTrajectory(Game.space, hintPos, hintVel, f.hintTrajectory); }
+	}
+	#endif
+
+	f.serial = ++Sim.serial;
+	f.build = Sim.build;
+	f.level = Game.level;
+	f.level_sides = Game.level_sides;
+	f.level_decks = Game.level_decks;
+	f.remain_sumos = Game.remain_sumos;
+	f.total_sumos = Game.total_sumos;
+	f.live_nerds = Game.live_nerds;
+	f.remainTicks = Game.remainTicks;
+	f.cannonRange = (Game.charging ? Game.ChargedSpeed() : 0.0f);
+	f.level_width = Game.level_width;
+	f.level_height = Game.level_height;
+	memcpy(f.level_decky, Game.level_decky, sizeof(f.level_decky));
+	f.result = Game.result;
+	f.stepMs = SandboxStats.stepMs;
+	f.scanMs = SandboxStats.scanMs;
+	f.memoryMB = SandboxMemoryMB();
+	f.profiling = (Game.profiler && PhysicsProfiler.Last());
+	if (f.profiling) f.profile = *PhysicsProfiler.Last();
+	Sim.published = target;
+}
+
+// Run the commands sent since the last update, the physics ticks for the elapsed time and the level rules, then publish a frame
+static void SimUpdate(int elapsed)
+{
+	#ifdef HAS_THREADS
+	Sim.mtx.lock();
+	#endif
+	Sim.pendingCommands.swap(Sim.commands);
+	sSimInput input = Sim.input;
+	#ifdef HAS_THREADS
+	Sim.mtx.unlock();
+	#endif
+
+	// Input is applied with the rules of the session (input they don't allow is dropped) so the logged input passes the verifier
+	for (size_t i = 0; i != Sim.pendingCommands.size(); i++)
+	{
+		// The hint search only restarts when the level state changes, aiming with charge and release keeps the current hint
+		const sSimCommand& cmd = Sim.pendingCommands[i];
+		if (cmd.type == sSimCommand::STOP_HINT) StopHintSolver();
+		else if (cmd.type == sSimCommand::BUILD)
+		{
+			StopHintSolver();
+			Game.BuildLevel(cmd.level, cmd.seed);
+			Sim.build = cmd.build;
+			Sim.tickSum = 0;
+		}
+		else if (cmd.type == sSimCommand::CHARGE) { if (Game.CanCharge()) Game.Charge(); }
+		else if (cmd.type == sSimCommand::RELEASE) { if (Game.CanRelease()) Game.Release(); }
+		else if (cmd.type == sSimCommand::FIRE && !cmd.rapid)
+		{
+			// The speed of a single shot is the charge counted in physics ticks
+			ZL_Vector vel = (cmd.vel == ZL_Vector::Zero ? cmd.vel : cmd.vel.VecWithLength(Game.ChargedSpeed()));
+			if (Game.CanFire(cmd.pos, vel)) { StopHintSolver(); Game.Fire(cmd.pos, vel); }
+			else if (Game.CanRelease()) Game.Release();
+		}
+		else if (cmd.type == sSimCommand::FIRE && i + 3 <= Sim.pendingCommands.size())
+		{
+			sInputEvent volley[3];
+			for (int n = 0; n != 3; n++) volley[n] = { sInputEvent::FIRE, Game.level_tick, Sim.pendingCommands[i + n].pos, Sim.pendingCommands[i + n].vel, true };
+			if (Game.CanFireVolley(volley)) { StopHintSolver(); Game.FireVolley(volley); }
+			i += 2;
+		}
+	}
+	Sim.pendingCommands.clear();
+	if (input.profile != !!Game.profiler)
+	{
+		if (input.profile) PhysicsProfiler.Reset();
+		else if (PhysicsProfiler.Dump("physics_profile.csv")) ZL_LOG("PROFILER", "Wrote %d physics steps to physics_profile.csv", PhysicsProfiler.count);
+		Game.profiler = (input.profile ? &PhysicsProfiler : NULL);
+	}
+	if (!input.running || !Game.space) return;
+
+	double perfStart = PerfMs();
+	int steps = 0;
+	sSession::eResult lastResult = Game.result;
+	for (Sim.tickSum += elapsed * input.speed; Sim.tickSum > PHYSICS_TICK; Sim.tickSum -= PHYSICS_TICK, steps++)
+	{
+		Game.Step();
+		Game.UpdateResult();
+	}
+	if (Game.profiler) Game.profiler->EndUpdate(steps);
+	double perfStep = PerfMs();
+
+	float remainvel = Game.CountRemaining();
+	if (Game.result != lastResult)
+	{
+		StopHintSolver();
+		#ifdef HAS_VERIFIER
+		if (Game.result == sSession::CLEARED && claimDir)
+		{
+			sClaim claim = { Game.level, Game.level_seed, Game.inputLog };
+			WriteClaim(ZL_String::format("%s/claim_%d_%u.txt", claimDir, Game.level, Game.level_seed).c_str(), claim);
+		}
+		#endif
+	}
+
+	if (IS_SANDBOX_LEVEL(Game.level))
+	{
+		SandboxStats.stepMs = ZL_Math::Lerp(SandboxStats.stepMs, (float)(perfStep - perfStart), .1f);
+		SandboxStats.scanMs = ZL_Math::Lerp(SandboxStats.scanMs, (float)(PerfMs() - perfStep), .1f);
+	}
+
+	#ifdef HAS_THREADS
+	if (input.hints && Game.result == sSession::PLAYING && Game.remainTicks && !Hint.thread.joinable() && remainvel < 500.0f) StartHintSolver();
+	#endif
+
+	PublishFrame(input);
+}
+
+#ifdef HAS_THREADS
+static void SimThread()
+{
+	double last = PerfMs();
+	while (!Sim.quit)
+	{
+		int elapsed = (int)(PerfMs() - last);
+		last += elapsed;
+		Sim.updateMtx.lock();
+		SimUpdate(elapsed);
+		Sim.updateMtx.unlock();
+		// Sleep until the next physics tick is due
+		std::this_thread::sleep_for(std::chrono::milliseconds(ZL_Math::Clamp(PHYSICS_TICK - Sim.tickSum, 1, PHYSICS_TICK)));
+	}
+}
+#endif
+
+#ifdef ZILLALOG //DEBUG DRAW
+// Physics debug geometry collected over the frame and drawn as a single batch of thin quads,
+// F5 limits it to moving bodies and F6 to the shapes found by a query of the visible area
+static struct sDebugDraw
+{
+	struct sLine { ZL_Vector a, b; ZL_Color col; float width; };
+	std::vector<sLine> lines;
+	bool movingOnly, viewOnly;
+
+	void Line(const ZL_Vector& a, const ZL_Vector& b, const ZL_Color& col, float width = 1) { lines.push_back({a, b, col, width}); }
+	void Point(const ZL_Vector& p, float r, const ZL_Color& col) { lines.push_back({p - ZLV(r, 0), p + ZLV(r, 0), col, -r*2}); } //negative width is in world units
+	void Circle(const ZL_Vector& p, float r, const ZL_Color& col)
+	{
+		for (int i = 0; i != 12; i++) Line(p + ZL_Vector::FromAngle(i*PI2/12)*r, p + ZL_Vector::FromAngle((i+1)*PI2/12)*r, col);
+	}
+
+	void Flush(float pixel)
+	{
+		if (lines.empty()) return;
+		srfWhite.BatchRenderBegin(true);
+		for (const sLine& l : lines)
+		{
+			ZL_Vector d = l.b - l.a;
+			float len = d.GetLength(), w = (l.width < 0 ? -l.width : l.width * pixel) * .5f;
+			ZL_Vector n = (len > 0 ? ZLV(-d.y / len * w, d.x / len * w) : ZLV(0, w));
+			srfWhite.DrawQuad(l.a + n, l.b + n, l.b - n, l.a - n, l.col);
+		}
+		srfWhite.BatchRenderEnd();
+		RenderStats.Add((int)lines.size() * 4, &srfWhite);
+		lines.clear();
+	}
+} DebugDraw;
+#endif
+
+// Dynamic resolution, when enabled the world is drawn into an offscreen target which is stretched to the screen afterwards.
+// The target scale steps down while the smoothed frame time misses 55 FPS and probes upwards again every few seconds.
+#define DYNRES_STEP .125f
+#define DYNRES_MIN .5f
+static struct sDynamicResolution
+{
+	ZL_Surface srf;
+	bool enabled;
+	float scale, frameMs;
+	ticks_t lastChange;
+	sDynamicResolution() : enabled(false), scale(1), frameMs(1000/60.f), lastChange(0) { }
+
+	bool Begin()
+	{
+		if (!enabled) { scale = 1; return false; }
+		frameMs = ZL_Math::Lerp(frameMs, ZLELAPSED * 1000.0f, .05f);
+		if (frameMs > 1000/55.f && scale > DYNRES_MIN && ZLSINCE(lastChange) > 250) { scale -= DYNRES_STEP; frameMs = 1000/60.f; lastChange = ZLTICKS; }
+		else if (frameMs < 1000/58.f && scale < 1 && ZLSINCE(lastChange) > 3000) { scale += DYNRES_STEP; frameMs = 1000/60.f; lastChange = ZLTICKS; }
+		if (scale >= 1) return false;
+
+		int w = (int)(ZLWIDTH * scale), h = (int)(ZLHEIGHT * scale);
+		if (!srf || srf.GetWidth() != w || srf.GetHeight() != h) srf = ZL_Surface(w, h);
+		srf.RenderToBegin(true);
+		ZL_Display::PushMatrix();
+		ZL_Display::Scale(scale);
+		return true;
+	}
+
+	void End()
+	{
+		ZL_Display::PopMatrix();
+		srf.RenderToEnd();
+		srf.DrawTo(0, 0, ZLWIDTH, ZLHEIGHT);
+		RenderStats.Add(4, &srf);
+	}
+} DynRes;
+
+#ifdef HAS_CAPTURE
+// Video capture of the window, each frame is read back into a ring of pixel buffer objects and mapped when it comes around again
+// so the transfer has two frames to complete. An encoder thread flips the rows and writes them as raw RGB24 video, frames are
+// dropped instead of waiting for it when it falls behind.
+#define CAPTURE_RING 3
+#define CAPTURE_QUEUE 8
+static struct sCapture
+{
+	GLuint pbo[CAPTURE_RING];
+	int x, y, w, h, frames, written, dropped;
+	FILE* f;
+	char path[64];
+	std::deque<std::vector<unsigned char> > queue;
+	std::vector<std::vector<unsigned char> > pool;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread thread;
+	bool stop;
+	sCapture() : f(NULL) { }
+	~sCapture() { StopEncoder(); }
+
+	void Start()
+	{
+		GLint vp[4];
+		glGetIntegerv(GL_VIEWPORT, vp);
+		x = vp[0]; y = vp[1]; w = vp[2]; h = vp[3];
+		snprintf(path, sizeof(path), "capture-%u.rgb", (unsigned int)ZLTICKS);
+		if (!(f = fopen(path, "wb"))) { ZL_LOG("CAPTURE", "Could not open %s", path); return; }
+		glGenBuffers(CAPTURE_RING, pbo);
+		for (GLuint buf : pbo)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, buf);
+			glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		frames = written = dropped = 0;
+		stop = false;
+		thread = std::thread([this]() { Encode(); });
+		ZL_LOG("CAPTURE", "Recording %dx%d to %s", w, h, path);
+	}
+
+	void Stop()
+	{
+		StopEncoder();
+		glDeleteBuffers(CAPTURE_RING, pbo);
+		ZL_LOG("CAPTURE", "Wrote %d frames (%d dropped), convert with: ffmpeg -f rawvideo -pixel_format rgb24 -video_size %dx%d -framerate 60 -i %s capture.mp4", written, dropped, w, h, path);
+	}
+
+	// Called after drawing, starts the read back of this frame and hands the oldest one in the ring to the encoder
+	void Frame()
+	{
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frames % CAPTURE_RING]);
+		glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		if (++frames >= CAPTURE_RING)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frames % CAPTURE_RING]);
+			if (const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY))
+			{
+				// Only take a pooled buffer and queue it under the lock, the copy runs without blocking the encoder
+				std::vector<unsigned char> buf;
+				mtx.lock();
+				bool full = (queue.size() >= CAPTURE_QUEUE);
+				if (full) dropped++;
+				else if (!pool.empty()) { buf.swap(pool.back()); pool.pop_back(); }
+				mtx.unlock();
+				if (!full)
+				{
+					buf.assign((const unsigned char*)pixels, (const unsigned char*)pixels + w * h * 4);
+					mtx.lock();
+					queue.emplace_back();
+					queue.back().swap(buf);
+					mtx.unlock();
+					cv.notify_one();
+				}
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	void Encode()
+	{
+		std::vector<unsigned char> pixels, row(w * 3);
+		for (std::unique_lock<std::mutex> lock(mtx);;)
+		{
+			cv.wait(lock, [this]() { return stop || !queue.empty(); });
+			if (queue.empty()) break;
+			pixels.swap(queue.front());
+			queue.pop_front();
+			lock.unlock();
+			for (int py = h; py--;) //read back rows are bottom up
+			{
+				const unsigned char* src = &pixels[py * w * 4];
+				for (int px = 0; px != w; px++) { row[px*3] = src[px*4]; row[px*3+1] = src[px*4+1]; row[px*3+2] = src[px*4+2]; }
+				fwrite(&row[0], 1, row.size(), f);
+			}
+			lock.lock();
+			written++;
+			pool.emplace_back();
+			pool.back().swap(pixels);
+		}
+	}
+
+	void StopEncoder()
+	{
+		if (!f) return;
+		mtx.lock();
+		stop = true;
+		mtx.unlock();
+		cv.notify_one();
+		thread.join();
+		fclose(f);
+		f = NULL;
+	}
+} Capture;
+#endif
+
+static void BuildLevel(int goto_level)
+{
+	goto_level = ZL_Math::Clamp(goto_level, 0, (int)(COUNT_OF(LevelSettings) + COUNT_OF(SandboxSettings)) - 1);
+	Sim.Send({sSimCommand::BUILD, goto_level, ++Sim.requestedBuild, (unsigned int)RAND_INT_RANGE(1, 0x7FFFFFFF)});
+	ticksClear = ticksFailed = 0;
+
+	static const ZL_Color skyColsTop[] = { ZLRGBFF( 23, 79,193) , ZLRGBFF( 16, 50,138) , ZLRGBFF(240,181, 52) , ZLRGBFF( 14, 38, 80) , ZLRGBFF( 54, 66,140) , ZLRGBFF( 22, 44, 68) , ZLRGBFF(141,104,137) , ZLRGBFF( 53, 57, 67) , ZLRGBFF(  9, 14, 39) , ZLRGBFF( 95,118,130) };
+	static const ZL_Color skyColsBot[] = { ZLRGBFF( 97,169,255) , ZLRGBFF(228,217,177) , ZLRGBFF(143, 61, 69) , ZLRGBFF(209,214,194) , ZLRGBFF(247,131, 62) , ZLRGBFF(232,192,109) , ZLRGBFF(252,170, 80) , ZLRGBFF(223,202,162) , ZLRGBFF(209,210,211) , ZLRGBFF(114, 59, 70) };
+
+	if (goto_level > 0)
+	{
+		colSkyTopTarget = RAND_ARRAYELEMENT(skyColsTop);
+		colSkyBottomTarget = RAND_ARRAYELEMENT(skyColsBot);
+	}
+	else
+	{
+		colSkyTopTarget = colSkyTop = skyColsTop[0];
+		colSkyBottomTarget = colSkyBottom = skyColsBot[0];
+		Game.CannonY = 150.0f;
+	}
+}
+
+static void Init()
+{
+	fntMain = ZL_Font("Data/matchbox.ttf.zip", 52);
+	srfGround = ZL_Surface("Data/ground.png").SetTextureRepeatMode(true);
+	srfAtlas = ZL_Surface("Data/atlas.png");
+	srfWhite = ZL_Surface(4, 4);
+	srfWhite.RenderToBegin(true);
+	ZL_Display::FillRect(0, 0, 4, 4, ZL_Color::White);
+	srfWhite.RenderToEnd();
+	#define ATLAS_SPRITE(name) srfAtlas.Clone().SetClipping(AtlasRegions[ATLAS_##name])
+	srfWood = ATLAS_SPRITE(WOOD);
+	srfMetal = ATLAS_SPRITE(METAL);
+	srfCannon = ATLAS_SPRITE(CANNON).SetOrigin(ZL_Origin::Custom(.5f, .5f)).SetScale(2, 1);
+	srfNerd = ATLAS_SPRITE(NERD).SetOrigin(ZL_Origin::Center).SetScale(1.5f);
+	srfNerdShirt = ATLAS_SPRITE(NERDSHIRT).SetOrigin(ZL_Origin::Center).SetScale(1.5f);
+	srfSumo = ATLAS_SPRITE(SUMO).SetOrigin(ZL_Origin::Center).SetScale(2.0f);
+	srfSumoPants = ATLAS_SPRITE(SUMOPANTS).SetOrigin(ZL_Origin::Center).SetScale(2.0f);
+
+	srfSmoke = ATLAS_SPRITE(SMOKE).SetOrigin(ZL_Origin::Center);
+
+	imcMusic.Play();
+	sndCannon = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCCANNON);
+	sndHit = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCHIT);
+	sndClear = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCCLEAR);
+	sndFail = ZL_SynthImcTrack::LoadAsSample(&imcDataIMCFAIL);
+
+}
+
+static void Update(const sFrame& frame)
+{
+	if (OnTitle) return;
+
+	// Effects for the sumos knocked out since the last frame, and the end of the level once the current build reached it
+	static unsigned int lastSerial;
+	if (frame.serial != lastSerial)
+	{
+		for (const sFrame::sKnockout& k : frame.knockouts)
+		{
+			if (k.serial <= lastSerial) continue; //already shown with an earlier frame
+			// Smoke stays within about 200 units of where it was spawned, don't spawn it far off screen
+			const ZL_Vector& p = k.p;
+			if (p.x > ViewRect.left - 200 && p.x < ViewRect.right + 200 && p.y > ViewRect.low - 200 && p.y < ViewRect.high + 200) Smoke.Spawn(200, p);
+			sndHit.Play();
+		}
+		lastSerial = frame.serial;
+		Sim.seenSerial = frame.serial;
+	}
+	if (frame.build == Sim.requestedBuild && !ticksClear && !ticksFailed)
+	{
+		if (frame.result == sSession::CLEARED) { ticksClear = ZLTICKS; sndClear.Play(); }
+		else if (frame.result == sSession::FAILED) { ticksFailed = ZLTICKS; sndFail.Play(); }
+	}
+
+	if (IS_SANDBOX_LEVEL(frame.level) && ZLSINCE(SandboxStats.logTicks) >= 1000)
+	{
+		SandboxStats.logTicks = ZLTICKS;
+		ZL_LOG("SANDBOX", "Bodies: %d - Step: %.2f ms - Scan: %.2f ms - Draw: %.2f ms - Memory: %.1f MB", (int)frame.items.size(), frame.stepMs, frame.scanMs, SandboxStats.drawMs, frame.memoryMB);
+	}
+
+	bool bPlaying = (frame.build == Sim.requestedBuild && !ticksClear && !ticksFailed && frame.remainTicks);
+	if (ZL_Input::Down() && bPlaying) { Game.CannonRange = 100.0f; Sim.Send({sSimCommand::CHARGE}); }
+	else if (Game.CannonRange && ZL_Input::Held() && bPlaying)
+	{
+		// The simulation counts the charge in physics ticks so the shot speed is part of the replayable input
+		Game.CannonRange = ZL_Math::Max(100.0f, frame.cannonRange);
+		if (RapidFire && Game.CannonVel != ZL_Vector::Zero && ZLSINCE(ticksRapidFire) >= RAPIDFIRE_INTERVAL)
+		{
+			// Scatter shot of three nerds side by side, fanned out around the aim direction
+			ZL_Vector side = ZL_Vector(-Game.CannonVel.y, Game.CannonVel.x).VecWithLength(RAPIDFIRE_OFFSET);
+			sSimCommand volley[3];
+			for (int n = -1; n <= 1; n++)
+				volley[n + 1] = {sSimCommand::FIRE, 0, 0, 0, ZLV(0, Game.CannonY) + side * (scalar)n, ZL_Vector::FromAngle(Game.CannonVel.GetAngle() + RAPIDFIRE_SPREAD * n + RAND_VARIATION(RAPIDFIRE_SPREAD * .5f)) * Game.CannonRange, true};
+			Sim.Send(volley, 3);
+			ticksRapidFire = ZLTICKS;
+			if (ZLSINCE(ticksRapidFireSound) > 120) { sndCannon.Play(); ticksRapidFireSound = ZLTICKS; }
+			if (ZLSINCE(lineticks) > 1000) SpeakRandomLine();
+		}
+	}
+	else if (Game.CannonRange && !RapidFire && ((ZL_Input::Up() && bPlaying) || !frame.remainTicks))
+	{
+		Sim.Send({sSimCommand::FIRE, 0, 0, 0, ZLV(0, Game.CannonY), Game.CannonVel, false});
+		sndCannon.Play();
+		SpeakRandomLine();
+		Game.CannonRange = 0;
+	}
+	else
+	{
+		if (Game.CannonRange) Sim.Send({sSimCommand::RELEASE});
+		Game.CannonRange = 0;
+	}
+
+	if (ZL_Input::Down(ZLK_R)) RapidFire ^= true;
+	if (ZL_Input::Down(ZLK_P)) ProfilePhysics ^= true;
+	if (ZL_Input::Down(ZLK_D)) DynRes.enabled ^= true;
+	#ifdef HAS_CAPTURE
+	if (ZL_Input::Down(ZLK_C)) { if (Capture.f) Capture.Stop(); else Capture.Start(); }
+	#endif
+	if (ZL_Input::Down(ZLK_H))
+	{
+		HintEnabled ^= true;
+		if (!HintEnabled) Sim.Send({sSimCommand::STOP_HINT});
+	}
+
+	if (!bPlaying && ZL_Input::Down())
+	{
+		if (ticksClear && ZLSINCE(ticksClear) > 250)
+		{
+			if (frame.level >= (int)COUNT_OF(LevelSettings)-1)
+			{
+				Sim.Send({sSimCommand::STOP_HINT});
+				OnTitle = true;
+				imcMusic.SetSongVolume(60);
+				titleswitchtick = ZLTICKS;
+			}
+			else
+				BuildLevel(frame.level + 1);
+		}
+		if (ticksFailed && ZLSINCE(ticksFailed) > 250) BuildLevel(frame.level);
+	}
+
+	#ifdef ZILLALOG //DEBUG
+	if (ZL_Input::Down(ZLK_F9)) BuildLevel(frame.level - 1);
+	if (ZL_Input::Down(ZLK_F10)) BuildLevel(frame.level);
+	if (ZL_Input::Down(ZLK_F11)) BuildLevel(frame.level + 1);
+	if (ZL_Input::Down(ZLK_F12)) BuildLevel(IS_SANDBOX_LEVEL(frame.level + 1) ? frame.level + 1 : (int)COUNT_OF(LevelSettings));
+	if (ZL_Input::Down(ZLK_F5)) DebugDraw.movingOnly ^= true;
+	if (ZL_Input::Down(ZLK_F6)) DebugDraw.viewOnly ^= true;
+	#endif
+
+	if (ZL_Input::Up(ZLK_ESCAPE, true))
+	{
+		Sim.Send({sSimCommand::STOP_HINT});
+		OnTitle = true;
+		imcMusic.SetSongVolume(60);
+	}
+
+	// Pass the state of the controls to the simulation, it traces the aim trajectory for the next frame
+	int speed = 1;
+	#ifdef ZILLALOG //DEBUG DRAW
+	if (ZL_Display::KeyDown[ZLK_LCTRL]) speed = 10;
+	#endif
+	Sim.SetInput({!OnTitle, Game.CannonRange > 0, HintEnabled, ProfilePhysics, speed, ZLV(0, Game.CannonY), Game.CannonVel});
+}
+
+// Camera transform from world to screen units, Draw applies it with the display matrix and uses the inverse for pointer and view calculations
+static void ApplyCamera()
+{
+	ZL_Display::Translate(ZLHALFW + Game.CameraX, 0);
+	ZL_Display::Scale(Game.CameraZoom);
+	ZL_Display::Translate(0, 50);
+}
+static ZL_Vector CameraScreenToWorld(const ZL_Vector& p) { return ZLV((p.x - ZLHALFW - Game.CameraX) / Game.CameraZoom, p.y / Game.CameraZoom - 50); }
+static ZL_Vector CameraWorldToScreen(const ZL_Vector& p) { return ZLV(p.x * Game.CameraZoom + ZLHALFW + Game.CameraX, (p.y + 50) * Game.CameraZoom); }
+
+// Draw the things as one batch per texture (walls and floors first, then sumos and the nerds on top),
+// the shadow pass draws the same geometry tinted black with the offset set by the caller
+static void DrawThingLists(const std::vector<const sFrame::sItem*> (&lists)[4], bool shadow)
+{
+	#define SUMO_SCALEW(t) (t->p.x > 0 ? -srfSumo.GetScaleW() : srfSumo.GetScaleW())
+	const ZL_Color tint = (shadow ? ZLLUMA(0, 0.5) : ZLWHITE);
+	for (int type = 0; type != 4; type++)
+		if (!lists[type].empty()) for (int layer = ((shadow || type == sThing::WALL || type == sThing::FLOOR) ? 1 : 2); layer--;) RenderStats.Add((int)lists[type].size() * 4, &srfAtlas); //sumos and nerds have a colored second layer
+	srfWood.BatchRenderBegin(true);
+	for (const sFrame::sItem* t : lists[sThing::WALL]) srfWood.DrawQuad(t->verts[0], t->verts[1], t->verts[2], t->verts[3], tint);
+	srfWood.BatchRenderEnd();
+	srfMetal.BatchRenderBegin(true);
+	for (const sFrame::sItem* t : lists[sThing::FLOOR]) srfMetal.DrawQuad(t->verts[0], t->verts[1], t->verts[2], t->verts[3], tint);
+	srfMetal.BatchRenderEnd();
+	srfSumo.BatchRenderBegin(true);
+	for (const sFrame::sItem* t : lists[sThing::SUMO]) srfSumo.Draw(t->p.x, t->p.y, t->a, SUMO_SCALEW(t), srfSumo.GetScaleH(), tint);
+	srfSumo.BatchRenderEnd();
+	if (!shadow)
+	{
+		srfSumoPants.BatchRenderBegin(true);
+		for (const sFrame::sItem* t : lists[sThing::SUMO]) srfSumoPants.Draw(t->p.x, t->p.y, t->a, SUMO_SCALEW(t), srfSumo.GetScaleH(), t->color);
+		srfSumoPants.BatchRenderEnd();
+	}
+	srfNerd.BatchRenderBegin(true);
+	for (const sFrame::sItem* t : lists[sThing::NERD]) srfNerd.Draw(t->p.x, t->p.y, t->a, tint);
+	srfNerd.BatchRenderEnd();
+	if (!shadow)
+	{
+		srfNerdShirt.BatchRenderBegin(true);
+		for (const sFrame::sItem* t : lists[sThing::NERD]) srfNerdShirt.Draw(t->p.x, t->p.y, t->a, t->color);
+		srfNerdShirt.BatchRenderEnd();
+	}
+}
+
+// Level of detail for zoomed out cameras where things are only a few pixels big, everything is drawn as flat colored quads in one batch
+#define LOD_FLAT_ZOOM .35f
+static const ZL_Color colFlatWall = ZLRGB(.6, .4, .2), colFlatFloor = ZLRGB(.5, .5, .55);
+static void DrawFlatItem(const sFrame::sItem* t)
+{
+	if (t->type == sThing::WALL || t->type == sThing::FLOOR) { srfWhite.DrawQuad(t->verts[0], t->verts[1], t->verts[2], t->verts[3], (t->type == sThing::WALL ? colFlatWall : colFlatFloor)); return; }
+	ZL_Vector ax = ZL_Vector::FromAngle(t->a), ay(-ax.y, ax.x);
+	if (t->type == sThing::SUMO) { ax *= 32.0f; ay *= 32.0f; } //sumo sprite is 32x32 scaled by 2
+	else { ax *= 12.0f; ay *= 24.0f; } //nerd sprite is 16x32 scaled by 1.5
+	srfWhite.DrawQuad(t->p - ax - ay, t->p + ax - ay, t->p + ax + ay, t->p - ax + ay, t->color);
+}
+
+static void DrawFlatLists(const std::vector<const sFrame::sItem*> (&lists)[4])
+{
+	size_t count = 0;
+	srfWhite.BatchRenderBegin(true);
+	for (const std::vector<const sFrame::sItem*>& list : lists) { for (const sFrame::sItem* t : list) DrawFlatItem(t); count += list.size(); }
+	srfWhite.BatchRenderEnd();
+	if (count) RenderStats.Add((int)count * 4, &srfWhite);
+}
+
+static void Draw(const sFrame& frame)
+{
+	if (OnTitle)
+	{
+		static ZL_Color introcolor = RAND_COLOR*.2f, introcolortgt = introcolor;
+		if ((ZLTICKS%1000) >= 500 && ((ZLTICKS-ZLELAPSEDTICKS)%1000) < 500) introcolortgt = RAND_COLOR*.2f;
+		introcolor = ZL_Color::Lerp(introcolor, introcolortgt, 0.01f);
+		ZL_Display::FillGradient(-10000, -5, 10000, ZL_Display::ScreenToWorld(0,ZLHEIGHT).y, introcolor, introcolor, introcolor, introcolor);
+
+		ZL_SeededRand rnd((ZLTICKS/100)*999);
+		float scale1 = rnd.Range(2.9f, 3.1f), scale2 = rnd.Range(2.9f, 3.1f);
+		static ZL_TextBuffer txtTitle(fntMain, 0.5f, "ANGRY\nNERDS");
+		static sOutlinedText txtTitleOutlined(txtTitle, 3.0f);
+		ZL_Display::PushMatrix();
+		ZL_Display::Translate(ZLHALFW, ZLHALFH+100);
+		ZL_Display::Rotate(rnd.Variation(.1f));
+		txtTitle.Draw(rnd.AngleVec()*40, scale1, scale1, ZLLUMA(0, .5), ZL_Origin::Center);
+		ZL_Display::PopMatrix();
+		ZL_Display::PushMatrix();
+		ZL_Display::Translate(ZLHALFW, ZLHALFH+100);
+		ZL_Display::Rotate(rnd.Variation(.1f));
+		txtTitleOutlined.Draw(ZL_Vector::Zero, scale2, ZL_Color(introcolor.g*5, introcolor.b*5, introcolor.r*5));
+		ZL_Display::PopMatrix();
+
+		srfSumo.Draw(150, ZLFROMH(300), 4, 4);
+		srfSumo.Draw(ZLFROMW(150), ZLFROMH(300), -4, 4);
+
+		static std::vector<ZL_Vector> nerds;
+		if (nerds.size() < 10 && (ZLTICKS%1000) >= 500 && ((ZLTICKS-ZLELAPSEDTICKS)%1000) < 500)
+			nerds.push_back(ZL_Vector(((nerds.size() & 1) ? ZLFROMW(150) : 150), ZLFROMH(300)) + RAND_ANGLEVEC * 800);
+
+		for (size_t i = nerds.size(); i--;)
+		{
+			ZL_Vector tgt(((i & 1) ? ZLFROMW(150) : 150), ZLFROMH(300));
+			nerds[i] = ZL_Vector::Lerp(nerds[i], tgt, .1f);
+			ZL_Vector dlt = tgt - nerds[i];
+			srfNerd.Draw(nerds[i], dlt.GetAngle()-PIHALF, 2, 2);
+			if (dlt < 80.0f) nerds[i] = tgt + RAND_ANGLEVEC * 800;
+		}
+
+		static sOutlinedText txtClickToPlay(ZL_TextBuffer(fntMain, "CLICK TO START"), 1.0f, 4);
+		static sOutlinedText txtInfo(ZL_TextBuffer(fntMain, 0.5f, "HOLD LEFT MOUSE BUTTON TO CHARGE THE NERD CANNON\nUSE W AND S KEYS OR RIGHT MOUSE BUTTON TO RAISE OR LOWER THE NERD CANNON"), .5f, 4);
+		static sOutlinedText txtFooter(ZL_TextBuffer(fntMain, "MADE IN 2022 BY BERNHARD SCHELLING FOR LUDUM DARE 51"), .4f, 3);
+		static sOutlinedText txtFullScreen(ZL_TextBuffer(fntMain, 0.5f, "CLICK HERE\nFULL SCREEN"), .6f, 3);
+
+		txtClickToPlay.Draw(ZLV(ZLHALFW, 200), 1.0f, ZL_Color::Yellow);
+		txtInfo.Draw(ZLV(ZLHALFW, 120*.8f), .5f);
+		txtFooter.Draw(ZLV(ZLHALFW, 25*.5f), .4f);
+
+		ZL_Rectf recFullScreen(ZLFROMW(300), ZLFROMH(140), ZLWIDTH-10, ZLHEIGHT-10);
+		bool hoverFullScreen = !!ZL_Input::Hover(recFullScreen);
+		ZL_Display::DrawRect(recFullScreen, ZLBLACK, ZLLUMA((hoverFullScreen ? .8 : .5), .5));
+		txtFullScreen.Draw(recFullScreen.Center(), .6f);
+		if (ZL_Input::Clicked(recFullScreen))
+		{
+			ZL_Display::ToggleFullscreen();
+		}
+
+		if (ZL_Input::ClickedOutside(recFullScreen) && ZLSINCE(titleswitchtick) > 500)
+		{
+			OnTitle = false;
+			imcMusic.SetSongVolume(40);
+			BuildLevel(0);
+		}
+		if (ZL_Input::Up(ZLK_ESCAPE, true) && ZLSINCE(titleswitchtick) > 500)
+			ZL_Application::Quit();
+		return;
+	}
+
+	// Calculate camera transform
+	float targetCameraX = 0;
+	if (frame.level_sides & 1) targetCameraX -= ZLHALFW-100;
+	if (frame.level_sides & 2) targetCameraX += ZLHALFW-100;
+	float targetCameraZoom = (frame.level_height ? ZL_Math::Min(ZLWIDTH / (frame.level_width + 100), ZLHEIGHT / frame.level_height) : Game.CameraZoom); //no level published yet
+	Game.CameraX = LerpSettle(Game.CameraX, targetCameraX, .1f, .01f);
+	Game.CameraZoom = LerpSettle(Game.CameraZoom, targetCameraZoom, .1f, .0001f);
+
+	// Visible world area, things are culled against it widened by their size and the shadow offset
+	ZL_Vector viewLo = CameraScreenToWorld(ZLV(0, 0)), viewHi = CameraScreenToWorld(ZLV(ZLWIDTH, ZLHEIGHT));
+	ViewRect = ZL_Rectf(viewLo.x, viewLo.y, viewHi.x, viewHi.y);
+	float margin = frame.itemRadius + 5;
+
+	// Sort the things in the grid cells overlapping the view by their texture, the shadow pass and the main pass both draw these lists.
+	// Tower pieces at rest go into separate lists which are baked into the background layer.
+	static std::vector<const sFrame::sItem*> lists[4], restingLists[4];
+	for (std::vector<const sFrame::sItem*>& list : lists) list.clear();
+	for (std::vector<const sFrame::sItem*>& list : restingLists) list.clear();
+	if (frame.gridW)
+	{
+		int cx0 = ZL_Math::Clamp((int)((ViewRect.left - margin - frame.gridX) / frame.gridCell), 0, frame.gridW - 1);
+		int cx1 = ZL_Math::Clamp((int)((ViewRect.right + margin - frame.gridX) / frame.gridCell), 0, frame.gridW - 1);
+		int cy0 = ZL_Math::Clamp((int)((ViewRect.low - margin - frame.gridY) / frame.gridCell), 0, frame.gridH - 1);
+		int cy1 = ZL_Math::Clamp((int)((ViewRect.high + margin - frame.gridY) / frame.gridCell), 0, frame.gridH - 1);
+		for (int cy = cy0; cy <= cy1; cy++)
+		{
+			const unsigned int *row = &frame.cellStart[cy * frame.gridW];
+			for (unsigned int i = row[cx0]; i != row[cx1 + 1]; i++)
+			{
+				const sFrame::sItem& t = frame.items[i];
+				if (t.p.x < ViewRect.left - margin || t.p.x > ViewRect.right + margin || t.p.y < ViewRect.low - margin || t.p.y > ViewRect.high + margin) continue;
+				(t.resting ? restingLists : lists)[t.type].push_back(&t);
+			}
+		}
+	}
+
+	// Sky, grass grounds and the tower pieces at rest only change with the level, the camera, the sky colors and when a piece starts or stops
+	// moving, they are rendered into a screen sized layer when one of these changes so the pieces at rest aren't sent again every frame
+	colSkyTop = LerpSettle(colSkyTop, colSkyTopTarget, .1f);
+	colSkyBottom = LerpSettle(colSkyBottom, colSkyBottomTarget, .1f);
+	bool flat = (Game.CameraZoom < LOD_FLAT_ZOOM);
+	static struct { ZL_Surface srf; int build; unsigned int resting; bool flat; float cameraX, cameraZoom; ZL_Color top, bottom; } Background;
+	if (!Background.srf || Background.srf.GetWidth() != (int)ZLWIDTH || Background.srf.GetHeight() != (int)ZLHEIGHT)
+	{
+		Background.srf = ZL_Surface((int)ZLWIDTH, (int)ZLHEIGHT);
+		Background.build = -1;
+	}
+	if (Background.build != frame.build || Background.resting != frame.restingKey || Background.flat != flat || Background.cameraX != Game.CameraX || Background.cameraZoom != Game.CameraZoom || Background.top != colSkyTop || Background.bottom != colSkyBottom)
+	{
+		Background.build = frame.build;
+		Background.resting = frame.restingKey;
+		Background.flat = flat;
+		Background.cameraX = Game.CameraX;
+		Background.cameraZoom = Game.CameraZoom;
+		Background.top = colSkyTop;
+		Background.bottom = colSkyBottom;
+
+		Background.srf.RenderToBegin(true);
+		ZL_Display::PushMatrix();
+		ApplyCamera();
+		ZL_Display::FillRect(ViewRect, ZL_Color::White);
+		ZL_Display::FillGradient(-10000, -5, 10000, ViewRect.high, colSkyTop, colSkyTop, colSkyBottom, colSkyBottom);
+		RenderStats.Add(4);
+		RenderStats.Add(4);
+
+		// Grass grounds, cut to the visible width (on whole texture repeats so the grass doesn't slide) and skipping decks outside of the view
+		#define GROUND_CUT(start) ((start) + (int)(ZL_Math::Max(0.0f, ViewRect.left - 5 - (start)) / 64) * 64.0f)
+		float groundRight = ZL_Math::Min(10000.0f, ViewRect.right + 5);
+		srfGround.DrawTo(GROUND_CUT(-10000.0f), -64, groundRight, 00);
+		RenderStats.Add(4, &srfGround);
+		for (int deck = 1; deck < frame.level_decks; deck++)
+		{
+			if (frame.level_decky[deck] < ViewRect.low || frame.level_decky[deck]-64 > ViewRect.high) continue;
+			if ((frame.level_sides & 1) && groundRight > 200) { srfGround.DrawTo(GROUND_CUT(200.0f), frame.level_decky[deck]-64, groundRight, frame.level_decky[deck]); RenderStats.Add(4, &srfGround); }
+			if ((frame.level_sides & 2) && ViewRect.left - 5 < -200) { srfGround.DrawTo(GROUND_CUT(-10000.0f), frame.level_decky[deck]-64, ZL_Math::Min(-200.0f, groundRight), frame.level_decky[deck]); RenderStats.Add(4, &srfGround); }
+		}
+		if (flat) DrawFlatLists(restingLists);
+		else
+		{
+			ZL_Display::PushMatrix();
+			ZL_Display::Translate(5, -5);
+			DrawThingLists(restingLists, true);
+			ZL_Display::PopMatrix();
+			DrawThingLists(restingLists, false);
+		}
+		ZL_Display::PopMatrix();
+		Background.srf.RenderToEnd();
+	}
+
+	// Transform camera, with dynamic resolution inside the scaled down world target
+	bool dynRes = DynRes.Begin();
+	ZL_Display::PushMatrix();
+	ApplyCamera();
+	Background.srf.DrawTo(ViewRect);
+	RenderStats.Add(4, &Background.srf);
+
+	// Calculate pointer position with transformed camera
+	ZL_Vector pointerInWorld = CameraScreenToWorld(ZL_Input::Pointer());
+	float moveY = ZL_Math::Clamp1(((ZL_Input::Held(ZLK_W) || ZL_Input::Held(ZLK_UP)) ? 1.f : 0.f)
+				+ ((ZL_Input::Held(ZLK_S) || ZL_Input::Held(ZLK_DOWN)) ? -1.f : 0.f)
+				+ ((ZL_Input::Held(ZL_BUTTON_RIGHT) && sabs(pointerInWorld.y - Game.CannonY) > 10 ) ? (pointerInWorld.y > Game.CannonY ? 1.f : -1.f) : 0.f));
+	if (moveY)
+	{
+		Game.CannonY = ZL_Math::Max(CANNON_MIN_Y, Game.CannonY + moveY * ZLELAPSEDF(CANNON_MOVE_SPEED));
+	}
+
+	// Draw Shadows (not visible when zoomed out to flat quads)
+	if (!flat)
+	{
+		ZL_Display::PushMatrix();
+		ZL_Display::Translate(5, -5);
+		DrawThingLists(lists, true);
+		ZL_Display::PopMatrix();
+	}
+
+	// Draw shoot line
+	ZL_Vector cannonDir = (pointerInWorld - ZLV(0, Game.CannonY)).Norm();
+	if (cannonDir.y < .25f) { cannonDir.x = (cannonDir.x < 0 ? -1.0f : 1.0f); cannonDir.y = .25f; cannonDir.Norm(); }
+	if (ZL_Input::Held() && Game.CannonRange)
+	{
+		Game.CannonVel = cannonDir * Game.CannonRange;
+		DrawTrajectory(frame.trajectory, frame.trajectoryHit, ZLLUMA(1, .6));
+		ZL_Display::DrawWideLine(ZLV(0, Game.CannonY), ZLV(0, Game.CannonY) + Game.CannonVel.VecWithLength(50.0f+Game.CannonRange*.1f), 5.0f, ZL_Color::White, ZL_Color::White);
+		RenderStats.Add(4);
+	}
+	if (HintEnabled && frame.hintFound)
+	{
+		ZL_Display::DrawCircle(frame.hintTrajectory[0], 30.0f, ZLRGBA(.3, 1, .3, .5));
+		RenderStats.Add(0);
+		DrawTrajectory(frame.hintTrajectory, frame.hintHit, ZLRGBA(.3, 1, .3, .4));
+	}
+	if (ZL_Input::Up())
+	{
+		linepos = CameraWorldToScreen(ZLV(0, Game.CannonY - 50));
+		if (linepos.x > ZLFROMW(50)) linepos.x = ZLFROMW(50);
+		if (linepos.x < 50) linepos.x = 50;
+		if (linepos.y < 50) linepos.y = 50;
+	}
+
+	// Draw all things
+	if (flat) DrawFlatLists(lists);
+	else DrawThingLists(lists, false);
+
+	// Draw cannon base and cannon
+	float throwAngle = cannonDir.GetAngle();
+	ZL_Display::FillRect(-25.0f, 0.0f, 25.0f, Game.CannonY, ZL_Color::Black);
+	srfCannon.Draw(0.0f, Game.CannonY, throwAngle, srfCannon.GetScaleW(), (cannonDir.x < 0 ? -srfCannon.GetScaleH() : srfCannon.GetScaleH()));
+	RenderStats.Add(4);
+	RenderStats.Add(4, &srfAtlas);
+
+	#ifdef ZILLALOG //DEBUG DRAW
+	if (ZL_Display::KeyDown[ZLK_LSHIFT])
+	{
+		DebugDraw.Line(ZLV(-10000, 0), ZLV(10000, 0), ZL_Color::Gray);
+		DebugDraw.Line(ZLV(0, -10000), ZLV(0, 10000), ZL_Color::Gray);
+		DebugDraw.Line(ZLV(-10000, frame.level_height), ZLV(10000, frame.level_height), ZL_Color::Gray);
+		DebugDraw.Line(ZLV(frame.level_width, -10000), ZLV(frame.level_width, 10000), ZL_Color::Gray);
+		DebugDraw.Line(ZLV(-frame.level_width, -10000), ZLV(-frame.level_width, 10000), ZL_Color::Gray);
+		{
+			#ifdef HAS_THREADS
+			std::lock_guard<std::mutex> lock(Sim.updateMtx); //debug only, pauses the simulation while reading its space
+			#endif
+			void DebugDrawShape(cpShape*,void*);
+			if (DebugDraw.viewOnly) cpSpaceBBQuery(Game.space, cpBBNew(ViewRect.left, ViewRect.low, ViewRect.right, ViewRect.high), CP_SHAPE_FILTER_ALL, DebugDrawShape, NULL);
+			else cpSpaceEachShape(Game.space, DebugDrawShape, NULL);
+			void DebugDrawConstraint(cpConstraint*, void*); cpSpaceEachConstraint(Game.space, DebugDrawConstraint, NULL);
+		}
+		DebugDraw.Flush(1.0f / Game.CameraZoom);
+	}
+	#endif
+
+	Smoke.Update(ZLELAPSED);
+	Smoke.Draw(ViewRect);
+
+	ZL_Display::PopMatrix();
+	if (dynRes) DynRes.End();
+
+	static sTextSlot hudLine(.5f), hudLevel, hudTime, hudRapid(.6f), hudRemain, hudProfile(.6f, false), hudSandbox(.6f, false), hudRender(.6f, false), hudResult;
+	if (lineticks && ZLSINCE(lineticks) < 1000)
+	{
+		if (hudLine.Changed((int)lineticks)) hudLine.Set("%s", lastline);
+		hudLine.Draw(linepos, 0.5f, ZLWHITE, (linepos.x < ZLHALFH/2 ? ZL_Origin::CenterLeft : (linepos.x > ZLHALFH*3/2 ? ZL_Origin::CenterRight : ZL_Origin::Center)));
+	}
+
+	if (hudLevel.Changed(frame.level))
+	{
+		if (IS_SANDBOX_LEVEL(frame.level)) hudLevel.Set("SANDBOX\n%d", frame.level+1-(int)COUNT_OF(LevelSettings));
+		else hudLevel.Set("LEVEL\n%d", frame.level+1);
+	}
+	hudLevel.Draw(ZLV(10, ZLFROMH(50)), 1, ZLWHITE, ZL_Origin::TopLeft);
+	int remainSeconds = ZL_Math::Max(0, (int)((999+frame.remainTicks)/1000));
+	if (hudTime.Changed(remainSeconds)) hudTime.Set("TIME\n%d", remainSeconds);
+	hudTime.Draw(ZLV(ZLHALFW, ZLFROMH(50)), 1, ZLWHITE, ZL_Origin::TopCenter);
+	if (RapidFire)
+	{
+		if (hudRapid.Changed(frame.live_nerds)) hudRapid.Set("RAPID FIRE - %d NERDS", frame.live_nerds);
+		hudRapid.Draw(ZLV(ZLHALFW, ZLFROMH(110)), .6f, ZL_Color::Yellow, ZL_Origin::TopCenter);
+	}
+	if (hudRemain.Changed(frame.remain_sumos, frame.total_sumos)) hudRemain.Set("REMAINING\n%d OF %d", frame.remain_sumos, frame.total_sumos);
+	hudRemain.Draw(ZLV(ZLFROMW(10), ZLFROMH(50)), 1, ZLWHITE, ZL_Origin::TopRight);
+
+	if (frame.profiling)
+	{
+		const sPhysicsProfiler::sSample& p = frame.profile;
+		if (hudProfile.Changed(HUNDREDTHS(p.stepMs), p.steps, p.bodies, p.contacts, p.arbiters, p.islands, p.beginCalls))
+			hudProfile.Set("PHYSICS %.2f MS X%d   BODIES %d   CONTACTS %d   ARBITERS %d   ISLANDS %d   BEGIN %d", p.stepMs, p.steps, p.bodies, p.contacts, p.arbiters, p.islands, p.beginCalls);
+		hudProfile.Draw(ZLV(10, (IS_SANDBOX_LEVEL(frame.level) ? 40 : 10)), .6f, ZL_Color::Yellow, ZL_Origin::BottomLeft);
+	}
+
+	if (frame.profiling || IS_SANDBOX_LEVEL(frame.level))
+	{
+		const SRenderStats& r = RenderStatsLast;
+		if (hudRender.Changed(r.drawCalls, r.vertices, r.textureBinds, r.texts, r.particles, frame.towerUpdates))
+			hudRender.Set("DRAW CALLS %d   VERTICES %d   TEXTURE BINDS %d   TEXTS %d   PARTICLES %d   MOVED %d", r.drawCalls, r.vertices, r.textureBinds, r.texts, r.particles, frame.towerUpdates);
+		hudRender.Draw(ZLV(10, (IS_SANDBOX_LEVEL(frame.level) ? 40 : 10) + (frame.profiling ? 30 : 0)), .6f, ZL_Color::Cyan, ZL_Origin::BottomLeft);
+	}
+
+	if (IS_SANDBOX_LEVEL(frame.level))
+	{
+		if (hudSandbox.Changed((int)frame.items.size(), HUNDREDTHS(frame.stepMs), HUNDREDTHS(frame.scanMs), HUNDREDTHS(SandboxStats.drawMs), (int)(frame.memoryMB*10.0f+.5f)))
+			hudSandbox.Set("BODIES %d   STEP %.2f MS   SCAN %.2f MS   DRAW %.2f MS   MEMORY %.1f MB", (int)frame.items.size(), frame.stepMs, frame.scanMs, SandboxStats.drawMs, frame.memoryMB);
+		hudSandbox.Draw(ZLV(10, 10), .6f, ZLWHITE, ZL_Origin::BottomLeft);
+	}
+
+	if (ticksClear || ticksFailed)
+	{
+		bool finished = (frame.level >= (int)COUNT_OF(LevelSettings)-1);
+		if (hudResult.Changed(ticksClear ? 1 : 0, finished))
+		{
+			if (ticksFailed) hudResult.Set("LEVEL FAILED!\n\nCLICK TO RETRY");
+			else if (finished) hudResult.Set("YOU FINISHED THE GAME!\n\nTHANKS FOR PLAYING!!\n\nCLICK TO GO BACK TO THE TITLE");
+			else hudResult.Set("LEVEL CLEARED!\n\nCLICK TO CONTINUE");
+		}
+		hudResult.Draw(ZLV(ZLHALFW, ZLHALFH), 1.0f, (ticksClear ? ZL_Color::Green : ZL_Color::Orange));
+	}
+}
+
+static struct sAngryNerds : public ZL_Application
+{
+	sAngryNerds() : ZL_Application(60) { }
+
+	virtual void Load(int argc, char *argv[])
+	{
+		#ifdef HAS_VERIFIER
+		// Headless batch verification of level clear claims: -verify <directory> [threads]
+		if (argc >= 3 && !strcmp(argv[1], "-verify")) exit(RunVerifier(argv[2], (argc >= 4 ? atoi(argv[3]) : 0)));
+		// Write a claim file for every cleared level: -claims <directory>
+		if (argc >= 3 && !strcmp(argv[1], "-claims")) claimDir = argv[2];
+		// Replay self test of a multi level session through the verifier: -replaytest <levels> [seed]
+		if (argc >= 3 && !strcmp(argv[1], "-replaytest")) exit(RunReplayTest(atoi(argv[2]), (argc >= 4 ? (unsigned int)atoi(argv[3]) : 0)));
+		#endif
+		#ifdef HAS_HEADLESS
+		// Headless load test with many concurrent sessions: -sessions <count> [threads] [seconds]
+		if (argc >= 3 && !strcmp(argv[1], "-sessions")) exit(RunSessionHost(atoi(argv[2]), (argc >= 4 ? atoi(argv[3]) : 0), (argc >= 5 ? atoi(argv[4]) : 0)));
+		// Solvability of generated levels as CSV: -solve <seeds per level> [threads]
+		if (argc >= 3 && !strcmp(argv[1], "-solve")) exit(RunSolver(atoi(argv[2]), (argc >= 4 ? atoi(argv[3]) : 0)));
+		#endif
+
+		if (!ZL_Application::LoadReleaseDesktopDataBundle()) return;
+		if (!ZL_Display::Init("Angry Nerds", 1280, 720, ZL_DISPLAY_ALLOWRESIZEHORIZONTAL)) return;
+		ZL_Display::ClearFill(ZL_Color::White);
+		ZL_Display::SetAA(true);
+		ZL_Audio::Init();
+		ZL_Input::Init();
+
+		#ifdef HAS_THREADS
+		Jobs.Start(ZL_Math::Max(0, (int)std::thread::hardware_concurrency() - 1));
+		Game.parallel = true;
+		Sim.thread = std::thread(SimThread);
+		#endif
+
+		Game.ts = tinysam_create();
+		tinysam_set_output(Game.ts, TINYSAM_STEREO_INTERLEAVED, 44100, .5f);
+		tinysam_set_speed(Game.ts, 100);
+		tinysam_speak_english(Game.ts, "Welcome to Angry Nerds");
 		ZL_Audio::HookAudioMix([](short* buffer, unsigned int samples, bool need_mix)
 		{
 			TSMTXLOCK();
-			bool res = !!tinysam_render_short(ts, buffer, samples, need_mix);
+			bool res = !!tinysam_render_short(Game.ts, buffer, samples, need_mix);
 			TSMTXUNLOCK();
 			return res;
 		});
@@ -832,58 +2775,77 @@ static struct sAngryNerds : public ZL_Application
 
 	virtual void AfterFrame()
 	{
-		::Update();
-		::Draw();
+		#ifndef HAS_THREADS
+		SimUpdate((int)ZLELAPSEDTICKS);
+		#endif
+		const sFrame& frame = Sim.BeginRead();
+		::Update(frame);
+		double perfDraw = PerfMs();
+		RenderStats.Reset();
+		::Draw(frame);
+		RenderStatsLast = RenderStats;
+		if (!OnTitle && ZLSINCE(RenderStatsLogTicks) >= 5000)
+		{
+			RenderStatsLogTicks = ZLTICKS;
+			ZL_LOG("RENDER", "Draw calls: %d - Vertices: %d - Texture binds: %d - Texts: %d - Particles: %d", RenderStats.drawCalls, RenderStats.vertices, RenderStats.textureBinds, RenderStats.texts, RenderStats.particles);
+		}
+		if (IS_SANDBOX_LEVEL(frame.level)) SandboxStats.drawMs = ZL_Math::Lerp(SandboxStats.drawMs, (float)(PerfMs() - perfDraw), .1f);
+		Sim.EndRead();
+		#ifdef HAS_CAPTURE
+		if (Capture.f) Capture.Frame();
+		#endif
 	}
 } AngryNerds;
 
 #ifdef ZILLALOG //DEBUG DRAW
 void DebugDrawShape(cpShape *shape, void*)
 {
+	if (DebugDraw.movingOnly && IsBodyResting(shape->body)) return;
 	switch (shape->klass->type)
 	{
 		case CP_CIRCLE_SHAPE: {
 			cpCircleShape *circle = (cpCircleShape *)shape;
-			ZL_Display::DrawCircle(circle->tc, circle->r, ZL_Color::Green);
+			DebugDraw.Circle(circle->tc, circle->r, ZL_Color::Green);
 			break; }
 		case CP_SEGMENT_SHAPE: {
 			cpSegmentShape *seg = (cpSegmentShape *)shape;
 			cpVect vw = cpvclamp(cpvperp(cpvsub(seg->tb, seg->ta)), seg->r);
-			//ZL_Display::DrawLine(seg->ta, seg->tb, ZLWHITE);
-			ZL_Display::DrawQuad(seg->ta.x + vw.x, seg->ta.y + vw.y, seg->tb.x + vw.x, seg->tb.y + vw.y, seg->tb.x - vw.x, seg->tb.y - vw.y, seg->ta.x - vw.x, seg->ta.y - vw.y, ZLRGBA(0,1,1,.35), ZLRGBA(1,1,0,.35));
-			ZL_Display::DrawCircle(seg->ta, seg->r, ZLRGBA(0,1,1,.35), ZLRGBA(1,1,0,.35));
-			ZL_Display::DrawCircle(seg->tb, seg->r, ZLRGBA(0,1,1,.35), ZLRGBA(1,1,0,.35));
+			DebugDraw.Line(cpvadd(seg->ta, vw), cpvadd(seg->tb, vw), ZLRGBA(0,1,1,.35));
+			DebugDraw.Line(cpvsub(seg->ta, vw), cpvsub(seg->tb, vw), ZLRGBA(1,1,0,.35));
+			DebugDraw.Circle(seg->ta, seg->r, ZLRGBA(0,1,1,.35));
+			DebugDraw.Circle(seg->tb, seg->r, ZLRGBA(0,1,1,.35));
 			break; }
 		case CP_POLY_SHAPE: {
 			cpPolyShape *poly = (cpPolyShape *)shape;
-			{for (int i = 1; i < poly->count; i++) ZL_Display::DrawLine(poly->planes[i-1].v0, poly->planes[i].v0, ZLWHITE);}
-			ZL_Display::DrawLine(poly->planes[poly->count-1].v0, poly->planes[0].v0, ZLWHITE);
+			{for (int i = 1; i < poly->count; i++) DebugDraw.Line(poly->planes[i-1].v0, poly->planes[i].v0, ZLWHITE);}
+			DebugDraw.Line(poly->planes[poly->count-1].v0, poly->planes[0].v0, ZLWHITE);
 			break; }
 	}
-	ZL_Display::FillCircle(cpBodyGetPosition(shape->body), 3, ZL_Color::Red);
-	ZL_Display::DrawLine(cpBodyGetPosition(shape->body), (ZL_Vector&)cpBodyGetPosition(shape->body) + ZLV(cpBodyGetAngularVelocity(shape->body)*-10, 0), ZLRGB(1,0,0));
-	ZL_Display::DrawLine(cpBodyGetPosition(shape->body), (ZL_Vector&)cpBodyGetPosition(shape->body) + ZL_Vector::FromAngle(cpBodyGetAngle(shape->body))*10, ZLRGB(1,1,0));
+	DebugDraw.Point(cpBodyGetPosition(shape->body), 3, ZL_Color::Red);
+	DebugDraw.Line(cpBodyGetPosition(shape->body), (ZL_Vector&)cpBodyGetPosition(shape->body) + ZLV(cpBodyGetAngularVelocity(shape->body)*-10, 0), ZLRGB(1,0,0));
+	DebugDraw.Line(cpBodyGetPosition(shape->body), (ZL_Vector&)cpBodyGetPosition(shape->body) + ZL_Vector::FromAngle(cpBodyGetAngle(shape->body))*10, ZLRGB(1,1,0));
 }
 
 void DebugDrawConstraint(cpConstraint *constraint, void *data)
 {
 	cpBody *body_a = constraint->a, *body_b = constraint->b;
+	if (DebugDraw.movingOnly && IsBodyResting(body_a) && IsBodyResting(body_b)) return;
 
 	if(cpConstraintIsPinJoint(constraint))
 	{
 		cpPinJoint *joint = (cpPinJoint *)constraint;
 		cpVect a = (cpBodyGetType(body_a) == CP_BODY_TYPE_KINEMATIC ? body_a->p : cpTransformPoint(body_a->transform, joint->anchorA));
 		cpVect b = (cpBodyGetType(body_b) == CP_BODY_TYPE_KINEMATIC ? body_b->p : cpTransformPoint(body_b->transform, joint->anchorB));
-		ZL_Display::DrawLine(a.x, a.y, b.x, b.y, ZL_Color::Magenta);
+		DebugDraw.Line(a, b, ZL_Color::Magenta);
 	}
 	else if (cpConstraintIsPivotJoint(constraint))
 	{
 		cpPivotJoint *joint = (cpPivotJoint *)constraint;
 		cpVect a = (cpBodyGetType(body_a) == CP_BODY_TYPE_KINEMATIC ? body_a->p : cpTransformPoint(body_a->transform, joint->anchorA));
 		cpVect b = (cpBodyGetType(body_b) == CP_BODY_TYPE_KINEMATIC ? body_b->p : cpTransformPoint(body_b->transform, joint->anchorB));
-		ZL_Display::DrawLine(a.x, a.y, b.x, b.y, ZL_Color::Magenta);
-		ZL_Display::FillCircle(a, 2, ZL_Color::Magenta);
-		ZL_Display::FillCircle(b, 2, ZL_Color::Magenta);
+		DebugDraw.Line(a, b, ZL_Color::Magenta);
+		DebugDraw.Point(a, 2, ZL_Color::Magenta);
+		DebugDraw.Point(b, 2, ZL_Color::Magenta);
 	}
 	else if (cpConstraintIsRotaryLimitJoint(constraint))
 	{
@@ -891,8 +2853,8 @@ void DebugDrawConstraint(cpConstraint *constraint, void *data)
 		cpVect a = cpTransformPoint(body_a->transform, cpvzero);
 		cpVect b = cpvadd(a, cpvmult(cpvforangle(joint->min), 40));
 		cpVect c = cpvadd(a, cpvmult(cpvforangle(joint->max), 40));
-		ZL_Display::DrawLine(a.x, a.y, b.x, b.y, ZL_Color::Magenta);
-		ZL_Display::DrawLine(a.x, a.y, c.x, c.y, ZL_Color::Magenta);
+		DebugDraw.Line(a, b, ZL_Color::Magenta);
+		DebugDraw.Line(a, c, ZL_Color::Magenta);
 	}
 }
 #endif
@@ -152,6 +152,9 @@ struct tinysam
 	struct _tinysam__renderstate lastFrameRenderState;
 	int lastFrameRenderedUntil, lastFramebufferPos, renderSamples;
 	unsigned short lastFrameFirstHistory;
+
+	unsigned char rulesIndexed;
+	unsigned short rulesIndex[108]; // offset of the first english rule for each (upper case) letter, 0 if there is none
 };
 
 struct _tinysam__output
@@ -793,6 +796,16 @@ TINYSAMDEF int tinysam_speak_english(tinysam* ts, const char* str)
 		0
 	};
 
+	// the rules are sorted by letter so index where each letter starts, rules1 and rules2 cover distinct letters
+	if (!ts->rulesIndexed)
+	{
+		const unsigned char* rulesets[2] = { rules1, rules2 };
+		for (int i = 0; i != 2; i++)
+			for (const unsigned char* r = rulesets[i]; *r; r++)
+				if (r[0] == '(' && !ts->rulesIndex[r[1]]) ts->rulesIndex[r[1]] = (unsigned short)(r - rulesets[i]);
+		ts->rulesIndexed = 1;
+	}
+
 	#ifdef TINYSAM_SAM_COMPATIBILITY
 	_tinysam__insert(ts, ts->phonemesCount, ' ', 0, 222);
 	#endif
@@ -817,10 +830,13 @@ TINYSAMDEF int tinysam_speak_english(tinysam* ts, const char* str)
 		if      (charflags[first] & FLAG_RULESET2)      rCursor = rules2;
 		else if (charflags[first] & FLAG_ALPHA_OR_QUOT) rCursor = rules1;
 		else { TINYSAM_ASSERT(0); return 0; }
+		if (!ts->rulesIndex[first]) return 0; //found no rule
+		rCursor += ts->rulesIndex[first];
 
 		for (const unsigned char *rOpen, *r, *next; *rCursor; rCursor++)
 		{
-			if (rCursor[0] != '(' || rCursor[1] != first) continue;
+			if (rCursor[0] != '(') continue;
+			if (rCursor[1] != first) return 0; //passed all rules of this letter without a match
 			for (rOpen = rCursor, rCursor += 2; *rCursor != ')' && *rCursor == _TS_UC(p[rCursor - rOpen - 1]); rCursor++);
 			if (*rCursor != ')') continue;
 